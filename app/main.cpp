@@ -1,11 +1,51 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <memory>
+#include "../libmtpviewmodel/cachingmtpdevice.h"
+#include "../libmtpviewmodel/mtpdeviceadapter.h"
 #include "../libmtpviewmodel/stubmtpdevice.h"
+#include "../libmtpviewmodel/tracingmtpdevice.h"
+#include "../libmtpviewmodel/mtphotplugmonitor.h"
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
-    StubMtpDevice stubDevice;
-    MainWindow window(&stubDevice);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"mtp", "Use the attached USB MTP device instead of the local stub."});
+    parser.process(app);
+
+    // The stub has no USB side, so only the real backend gets a hotplug
+    // monitor; its sessions are the ones the adapter's calls run on.
+    std::unique_ptr<IMtpDevice> backend;
+    std::unique_ptr<MtpHotplugMonitor> hotplug;
+    if (parser.isSet("mtp")) {
+        backend = std::make_unique<MtpDeviceAdapter>();
+        hotplug = std::make_unique<MtpHotplugMonitor>(MtpHotplugMonitor::Auto);
+        hotplug->start();
+    } else {
+        backend = std::make_unique<StubMtpDevice>();
+    }
+
+    TracingMtpDevice tracedDevice(backend.get());
+    // Object IDs aren't stable across a reconnect, so cached content is
+    // dropped whenever a device comes or goes.
+    CachingMtpDevice cachedDevice(&tracedDevice);
+    if (hotplug) {
+        QObject::connect(hotplug.get(), &MtpHotplugMonitor::deviceAdded, [&cachedDevice]() { cachedDevice.invalidateAll(); });
+        QObject::connect(hotplug.get(), &MtpHotplugMonitor::deviceRemoved, [&cachedDevice]() { cachedDevice.invalidateAll(); });
+    }
+    MainWindow window(&cachedDevice, hotplug.get());
     window.show();
-    return app.exec();
+    int rc = app.exec();
+
+    if (MtpTrace::isEnabled()) {
+        QString traceFile = qEnvironmentVariable("MTP_TRACE_FILE", "mtp_trace.json");
+        if (MtpTrace::writeChromeTrace(traceFile))
+            qInfo() << "Trace written to" << traceFile;
+        qInfo().noquote() << MtpTrace::exportHistograms();
+    }
+    return rc;
 }
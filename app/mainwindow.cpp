@@ -1,11 +1,19 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "mtptrace.h"
+#include <QDateTime>
 #include <QInputDialog>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QTextStream>
 
-MainWindow::MainWindow(IMtpDevice *device, QWidget *parent)
+namespace {
+
+const QStringList fileModelHeaders = {"Name", "Size", "Files", "Modified"};
+
+} // namespace
+
+MainWindow::MainWindow(IMtpDevice *device, MtpHotplugMonitor *hotplug, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , viewModel(new MtpViewModel(device, this))
@@ -13,13 +21,20 @@ MainWindow::MainWindow(IMtpDevice *device, QWidget *parent)
 {
     ui->setupUi(this);
     ui->fileTreeView->setModel(fileModel);
-    fileModel->setHorizontalHeaderLabels({"Name"});
+    fileModel->setHorizontalHeaderLabels(fileModelHeaders);
 
     connect(viewModel, &MtpViewModel::deviceUpdated, this, &MainWindow::updateDeviceInfo);
     connect(viewModel, &MtpViewModel::fileListUpdated, this, &MainWindow::updateFileList);
+    connect(viewModel, &MtpViewModel::directoryStatsUpdated, this, &MainWindow::updateDirectoryStats);
     connect(viewModel, &MtpViewModel::operationFailed, this, &MainWindow::displayError);
     connect(viewModel, &MtpViewModel::fileRead, this, &MainWindow::displayFileData);
 
+    if (hotplug) {
+        connect(hotplug, &MtpHotplugMonitor::deviceAdded, this, &MainWindow::onHotplug);
+        connect(hotplug, &MtpHotplugMonitor::deviceRemoved, this, &MainWindow::onHotplug);
+        connect(viewModel, &MtpViewModel::busyChanged, this, &MainWindow::onBusyChanged);
+    }
+
     connect(ui->refreshButton, &QPushButton::clicked, this, &MainWindow::onRefreshButtonClicked);
     connect(ui->createDirButton, &QPushButton::clicked, this, &MainWindow::onCreateDirectoryClicked);
     connect(ui->deleteDirButton, &QPushButton::clicked, this, &MainWindow::onDeleteDirectoryClicked);
@@ -56,6 +71,7 @@ QString MainWindow::getFullPath(QStandardItem *item) const {
 }
 
 void MainWindow::updateFileList(const QStringList &files) {
+    MTP_TRACE_SPAN("app.modelRebuild", "app");
     QSet<QString> allPaths;
     for (const QString &file : files) {
         QString normalized = file;
@@ -76,7 +92,7 @@ void MainWindow::updateFileList(const QStringList &files) {
     std::sort(sortedPaths.begin(), sortedPaths.end());
 
     fileModel->clear();
-    fileModel->setHorizontalHeaderLabels({"Name"});
+    fileModel->setHorizontalHeaderLabels(fileModelHeaders);
     QStandardItem *rootItem = fileModel->invisibleRootItem();
 
     for (const QString &file : sortedPaths) {
@@ -100,11 +116,42 @@ void MainWindow::updateFileList(const QStringList &files) {
                 bool isDir = (i == parts.size() - 1 && file.endsWith('/')) || (i < parts.size() - 1);
                 item->setData(fullPath + (isDir ? "/" : ""), Qt::UserRole + 1);
                 item->setData(isDir, Qt::UserRole + 2);
-                parent->appendRow(item);
+                parent->appendRow({item, new QStandardItem, new QStandardItem, new QStandardItem});
             }
             parent = item;
         }
     }
+
+    fillStatsColumns(rootItem);
+}
+
+void MainWindow::updateDirectoryStats() {
+    fillStatsColumns(fileModel->invisibleRootItem());
+}
+
+void MainWindow::fillStatsColumns(QStandardItem *parent) {
+    const MtpDirectoryRollup &rollup = viewModel->directoryRollup();
+    const QLocale locale;
+    for (int row = 0; row < parent->rowCount(); ++row) {
+        QStandardItem *item = parent->child(row, 0);
+        const QString path = item->data(Qt::UserRole + 1).toString();
+        quint64 bytes = 0;
+        qint64 mtime = 0;
+        QString files;
+        if (item->data(Qt::UserRole + 2).toBool()) {
+            const MtpDirectoryStats stats = rollup.stats(path);
+            bytes = stats.totalBytes;
+            mtime = stats.newestMtime;
+            files = QString::number(stats.fileCount);
+            fillStatsColumns(item);
+        } else if (!rollup.fileStats(path, bytes, mtime)) {
+            continue;
+        }
+
+        parent->child(row, 1)->setText(locale.formattedDataSize(static_cast<qint64>(bytes)));
+        parent->child(row, 2)->setText(files);
+        parent->child(row, 3)->setText(mtime > 0 ? locale.toString(QDateTime::fromSecsSinceEpoch(mtime), QLocale::ShortFormat) : QString());
+    }
 }
 
 void MainWindow::displayError(const QString &error) {
@@ -122,6 +169,25 @@ void MainWindow::displayFileData(const QByteArray &data) {
     msgBox.exec();
 }
 
+void MainWindow::onHotplug(const MtpHotplugDevice &device) {
+    Q_UNUSED(device);
+    // A busy view model may have started before the device's session was
+    // registered, so the refresh waits for it rather than being dropped;
+    // waiting also spares the "busy" warning for something the user didn't
+    // click.
+    if (viewModel->isBusy())
+        refreshQueued = true;
+    else
+        viewModel->refreshDevice();
+}
+
+void MainWindow::onBusyChanged(bool busy) {
+    if (!busy && refreshQueued) {
+        refreshQueued = false;
+        viewModel->refreshDevice();
+    }
+}
+
 void MainWindow::onRefreshButtonClicked() {
     viewModel->refreshDevice();
 }
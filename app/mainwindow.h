@@ -5,6 +5,7 @@
 #include <QStandardItemModel>
 #include "mtpviewmodel.h"
 #include "imtdevice.h"
+#include "mtphotplugmonitor.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -14,14 +15,17 @@ class MainWindow : public QMainWindow {
     Q_OBJECT
 
 public:
-    MainWindow(IMtpDevice *device, QWidget *parent = nullptr);
+    MainWindow(IMtpDevice *device, MtpHotplugMonitor *hotplug = nullptr, QWidget *parent = nullptr);
     ~MainWindow();
 
 private slots:
     void updateDeviceInfo();
     void updateFileList(const QStringList &files);
+    void updateDirectoryStats();
     void displayError(const QString &error);
     void displayFileData(const QByteArray &data);
+    void onHotplug(const MtpHotplugDevice &device);
+    void onBusyChanged(bool busy);
 
     void onRefreshButtonClicked();
     void onCreateDirectoryClicked();
@@ -34,8 +38,10 @@ private slots:
 
 private:
     QString getFullPath(QStandardItem *item) const;
+    void fillStatsColumns(QStandardItem *parent);
     Ui::MainWindow *ui;
     MtpViewModel *viewModel;
     QStandardItemModel *fileModel;
+    bool refreshQueued = false;
 };
 #endif // MAINWINDOW_H
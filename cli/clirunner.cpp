@@ -0,0 +1,391 @@
+#include "clirunner.h"
+#include "mtpexporter.h"
+#include "mtpimportstore.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QRegularExpression>
+#include <cstdio>
+
+namespace {
+
+const quint64 kChunkSize = 4 * 1024 * 1024;
+
+QString devicePathOf(const QString &path) {
+    return path.startsWith('/') ? path : '/' + path;
+}
+
+QString withoutTrailingSlash(const QString &path) {
+    return path.size() > 1 && path.endsWith('/') ? path.chopped(1) : path;
+}
+
+QString baseName(const QString &path) {
+    const QString bare = withoutTrailingSlash(path);
+    return bare.mid(bare.lastIndexOf('/') + 1);
+}
+
+// Listings mark folders with a trailing slash, but paths typed by the user
+// usually don't have one.
+bool isDirectory(IMtpDevice *device, const QString &path) {
+    if (path.endsWith('/'))
+        return true;
+    MtpFileInfo info;
+    return device->statFile(path, info) && info.isDir;
+}
+
+bool hasWildcard(const QString &pattern) {
+    static const QRegularExpression wildcard("[*?\\[]");
+    return pattern.contains(wildcard);
+}
+
+} // namespace
+
+
+CliOutput::CliOutput(bool json, bool showDevice)
+    : m_json(json), m_showDevice(showDevice)
+{
+}
+
+void CliOutput::result(const QString &device, const QString &op, const QString &path, bool ok,
+                       const QJsonObject &fields, const QString &text) {
+    QByteArray line;
+    if (m_json) {
+        QJsonObject obj = fields;
+        obj["device"] = device;
+        obj["op"] = op;
+        obj["path"] = path;
+        obj["ok"] = ok;
+        line = QJsonDocument(obj).toJson(QJsonDocument::Compact);
+    } else {
+        QString message = text.isEmpty() ? path : text;
+        if (!ok)
+            message = QString("error: %1 %2 failed").arg(op, path);
+        if (m_showDevice)
+            message = device + ": " + message;
+        line = message.toUtf8();
+    }
+    line += '\n';
+
+    QMutexLocker locker(&m_mutex);
+    FILE *stream = ok || m_json ? stdout : stderr;
+    std::fwrite(line.constData(), 1, static_cast<size_t>(line.size()), stream);
+    std::fflush(stream);
+}
+
+
+CliRunner::CliRunner(CliOutput &output)
+    : m_output(output)
+{
+}
+
+QStringList CliRunner::commands() {
+    return {"list", "stat", "pull", "push", "rm", "mkdir", "sync", "import"};
+}
+
+bool CliRunner::isCommand(const QString &command) {
+    return commands().contains(command);
+}
+
+QString CliRunner::usageError(const QString &command, const QStringList &args) {
+    if ((command == "stat" || command == "rm" || command == "mkdir") && args.isEmpty())
+        return QString("%1 needs at least one device path").arg(command);
+    if ((command == "pull" || command == "push") && args.size() < 2)
+        return QString("%1 needs at least one source and a destination").arg(command);
+    if ((command == "sync" || command == "import") && args.size() != 2)
+        return QString("%1 needs a device directory and a local directory").arg(command);
+    return QString();
+}
+
+int CliRunner::run(const QString &label, IMtpDevice *device, const QString &command,
+                   const QStringList &args, const QString &localRoot) {
+    if (command == "list")
+        return list(label, device, args.isEmpty() ? QStringList{"/"} : args);
+    if (command == "stat")
+        return stat(label, device, args);
+    if (command == "pull")
+        return pull(label, device, args.mid(0, args.size() - 1), localRoot.isEmpty() ? args.last() : localRoot);
+    if (command == "push")
+        return push(label, device, args.mid(0, args.size() - 1), args.last());
+    if (command == "rm")
+        return remove(label, device, args);
+    if (command == "mkdir")
+        return mkdir(label, device, args);
+    if (command == "sync")
+        return sync(label, device, args.at(0), localRoot.isEmpty() ? args.at(1) : localRoot);
+    if (command == "import")
+        return importTree(label, device, args.at(0), localRoot.isEmpty() ? args.at(1) : localRoot);
+    return 1;
+}
+
+// Globs are matched against a single listing of the deepest directory that
+// has no wildcard in it, so "/DCIM/*/*.jpg" costs one enumeration of /DCIM.
+QStringList CliRunner::expand(const QString &label, IMtpDevice *device, const QStringList &patterns) {
+    QStringList result;
+    for (const QString &pattern : patterns) {
+        const QString normalized = devicePathOf(pattern);
+        if (!hasWildcard(normalized)) {
+            result << normalized;
+            continue;
+        }
+
+        const int firstWildcard = normalized.indexOf(QRegularExpression("[*?\\[]"));
+        const QString base = normalized.left(normalized.lastIndexOf('/', firstWildcard) + 1);
+        const QRegularExpression re(QRegularExpression::wildcardToRegularExpression(withoutTrailingSlash(normalized)));
+
+        int matches = 0;
+        const QStringList entries = device->getFileList(base);
+        for (const QString &entry : entries) {
+            const QString path = devicePathOf(entry);
+            if (re.match(withoutTrailingSlash(path)).hasMatch()) {
+                result << path;
+                ++matches;
+            }
+        }
+        if (matches == 0)
+            m_output.result(label, "glob", pattern, false);
+    }
+    return result;
+}
+
+// An empty listing is also what a failed one looks like, so it is only
+// trusted for a folder that can be stat'ed (or the root of a device that is
+// there); a plain file lists as itself.
+int CliRunner::list(const QString &label, IMtpDevice *device, const QStringList &args) {
+    int rc = 0;
+    for (const QString &arg : args) {
+        QStringList entries;
+        if (hasWildcard(arg)) {
+            entries = expand(label, device, {arg});
+            if (entries.isEmpty())
+                rc = 1;
+        } else {
+            entries = device->getFileList(arg);
+            const QString path = withoutTrailingSlash(devicePathOf(arg));
+            MtpFileInfo info;
+            info.isDir = true;
+            const bool ok = !entries.isEmpty()
+                || (path == "/" ? !device->detectDevices().isEmpty() : device->statFile(path, info));
+            if (!ok) {
+                m_output.result(label, "list", path, false);
+                rc = 1;
+            } else if (!info.isDir) {
+                entries << path;
+            }
+        }
+        for (const QString &entry : std::as_const(entries)) {
+            const QString path = devicePathOf(entry);
+            m_output.result(label, "list", path, true, QJsonObject{{"isDir", path.endsWith('/')}});
+        }
+    }
+    return rc;
+}
+
+int CliRunner::stat(const QString &label, IMtpDevice *device, const QStringList &args) {
+    int rc = 0;
+    for (const QString &path : expand(label, device, args)) {
+        MtpFileInfo info;
+        if (!device->statFile(path, info)) {
+            m_output.result(label, "stat", path, false);
+            rc = 1;
+            continue;
+        }
+        const QString mtime = info.modified.toUTC().toString(Qt::ISODate);
+        QJsonObject fields{
+            {"objectId", double(info.objectId)},
+            {"size", double(info.size)},
+            {"mtime", mtime},
+            {"isDir", info.isDir}
+        };
+        m_output.result(label, "stat", path, true, fields,
+                        QString("%1\t%2\t%3\t%4").arg(QString(info.isDir ? "d" : "f")).arg(info.size).arg(mtime, path));
+    }
+    return rc;
+}
+
+bool CliRunner::copyToLocal(IMtpDevice *device, const MtpFileInfo &object, const QString &localPath, quint64 &bytes) {
+    QDir().mkpath(QFileInfo(localPath).absolutePath());
+    QFile part(localPath + ".part");
+    if (!part.open(QIODevice::WriteOnly))
+        return false;
+
+    bytes = 0;
+    for (;;) {
+        QByteArray chunk;
+        if (!device->readObjectRange(object, bytes, kChunkSize, chunk) || part.write(chunk) != chunk.size()) {
+            part.remove();
+            return false;
+        }
+        bytes += chunk.size();
+        if (static_cast<quint64>(chunk.size()) < kChunkSize)
+            break;
+    }
+    part.close();
+    QFile::remove(localPath);
+    return part.rename(localPath);
+}
+
+int CliRunner::pull(const QString &label, IMtpDevice *device, const QStringList &sources, const QString &localDir) {
+    int rc = 0;
+    for (const QString &source : expand(label, device, sources)) {
+        const QString target = localDir + '/' + baseName(source);
+        if (isDirectory(device, source)) {
+            MtpExporter exporter(device);
+            MtpExportResult result = exporter.exportTree(source, target);
+            for (const QString &failed : std::as_const(result.failedPaths))
+                m_output.result(label, "pull", failed, false);
+            m_output.result(label, "pull", source, result.filesFailed == 0,
+                            QJsonObject{{"files", result.filesCopied}, {"failed", result.filesFailed},
+                                        {"bytes", double(result.bytesCopied)}, {"ms", double(result.elapsedMs)}},
+                            QString("%1 -> %2 (%3 files, %4 bytes, %5 MB/s)")
+                                .arg(source, target).arg(result.filesCopied).arg(result.bytesCopied)
+                                .arg(result.throughputMBps(), 0, 'f', 1));
+            if (result.filesFailed > 0)
+                rc = 1;
+        } else {
+            quint64 bytes = 0;
+            MtpFileInfo info;
+            bool ok = device->statFile(source, info) && copyToLocal(device, info, target, bytes);
+            m_output.result(label, "pull", source, ok, QJsonObject{{"bytes", double(bytes)}, {"local", target}},
+                            QString("%1 -> %2 (%3 bytes)").arg(source, target).arg(bytes));
+            if (!ok)
+                rc = 1;
+        }
+    }
+    return rc;
+}
+
+int CliRunner::push(const QString &label, IMtpDevice *device, const QStringList &sources, const QString &deviceDir) {
+    int rc = 0;
+    const QString targetDir = withoutTrailingSlash(devicePathOf(deviceDir));
+    const QString prefix = targetDir == "/" ? QString("/") : targetDir + '/';
+
+    auto pushFile = [&](const QString &localPath, const QString &devicePath) {
+        QFile file(localPath);
+        const bool ok = file.open(QIODevice::ReadOnly) && device->writeFile(devicePath, file.readAll());
+        m_output.result(label, "push", devicePath, ok, QJsonObject{{"local", localPath}, {"bytes", double(file.size())}},
+                        QString("%1 -> %2").arg(localPath, devicePath));
+        if (!ok)
+            rc = 1;
+    };
+
+    for (const QString &source : sources) {
+        QFileInfo fi(source);
+        if (fi.isDir()) {
+            const QString root = prefix + fi.fileName() + '/';
+            device->createDirectory(root);
+            QDirIterator it(fi.absoluteFilePath(), QDir::NoDotAndDotDot | QDir::AllEntries, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                it.next();
+                const QString rel = QDir(fi.absoluteFilePath()).relativeFilePath(it.filePath());
+                if (it.fileInfo().isDir())
+                    device->createDirectory(root + rel + '/');
+                else
+                    pushFile(it.filePath(), root + rel);
+            }
+        } else if (fi.isFile()) {
+            pushFile(source, prefix + fi.fileName());
+        } else {
+            m_output.result(label, "push", source, false);
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+int CliRunner::remove(const QString &label, IMtpDevice *device, const QStringList &args) {
+    int rc = 0;
+    for (const QString &path : expand(label, device, args)) {
+        const bool ok = isDirectory(device, path) ? device->deleteDirectory(path) : device->deleteFile(path);
+        m_output.result(label, "rm", path, ok);
+        if (!ok)
+            rc = 1;
+    }
+    return rc;
+}
+
+int CliRunner::mkdir(const QString &label, IMtpDevice *device, const QStringList &args) {
+    int rc = 0;
+    for (const QString &arg : args) {
+        const QString path = withoutTrailingSlash(devicePathOf(arg)) + '/';
+        const bool ok = device->createDirectory(path);
+        m_output.result(label, "mkdir", path, ok);
+        if (!ok)
+            rc = 1;
+    }
+    return rc;
+}
+
+// One-way device to host mirror. Local copies get the device mtime, so a
+// repeated sync only costs the listing, which carries sizes and mtimes.
+int CliRunner::sync(const QString &label, IMtpDevice *device, const QString &deviceDir, const QString &localDir) {
+    int rc = 0;
+    int copied = 0;
+    int skipped = 0;
+    const QString base = withoutTrailingSlash(devicePathOf(deviceDir));
+    const QString prefix = base == "/" ? QString("/") : base + '/';
+
+    const QVector<MtpFileInfo> entries = device->getFileInfoList(prefix);
+    for (const MtpFileInfo &info : entries) {
+        const QString path = devicePathOf(info.path);
+        const QString localPath = MtpExporter::localPathFor(prefix, path, localDir);
+        if (localPath.isEmpty()) {
+            // A device name such as ".." would land outside localDir.
+            m_output.result(label, "sync", path, false);
+            rc = 1;
+            continue;
+        }
+
+        if (info.isDir) {
+            QDir().mkpath(localPath);
+            continue;
+        }
+
+        QFileInfo local(localPath);
+        if (local.exists() && static_cast<quint64>(local.size()) == info.size
+            && local.lastModified().toSecsSinceEpoch() == info.modified.toSecsSinceEpoch()) {
+            ++skipped;
+            continue;
+        }
+
+        quint64 bytes = 0;
+        bool ok = copyToLocal(device, info, localPath, bytes);
+        if (ok) {
+            QFile file(localPath);
+            if (file.open(QIODevice::ReadWrite))
+                file.setFileTime(info.modified, QFileDevice::FileModificationTime);
+            ++copied;
+        } else {
+            rc = 1;
+        }
+        m_output.result(label, "sync", path, ok, QJsonObject{{"bytes", double(bytes)}, {"local", localPath}},
+                        QString("%1 -> %2").arg(path, localPath));
+    }
+
+    m_output.result(label, "sync", prefix, rc == 0, QJsonObject{{"copied", copied}, {"skipped", skipped}},
+                    QString("%1: %2 copied, %3 up to date").arg(prefix).arg(copied).arg(skipped));
+    return rc;
+}
+
+// The store index isn't shared between threads, so devices import one at a
+// time even with --jobs; the saving comes from skipping transfers anyway.
+int CliRunner::importTree(const QString &label, IMtpDevice *device, const QString &deviceDir, const QString &destDir) {
+    QMutexLocker locker(&m_storeMutex);
+    MtpImportStore store(m_storePath.isEmpty() ? destDir + "/.mtp-store" : m_storePath);
+    if (!store.isValid()) {
+        m_output.result(label, "import", deviceDir, false);
+        return 1;
+    }
+
+    MtpImportResult result = store.import(device, devicePathOf(deviceDir), destDir);
+    for (const QString &failed : std::as_const(result.failedPaths))
+        m_output.result(label, "import", failed, false);
+    m_output.result(label, "import", deviceDir, result.failed == 0,
+                    QJsonObject{{"imported", result.imported}, {"deduplicated", result.deduplicated},
+                                {"failed", result.failed}, {"bytesTransferred", double(result.bytesTransferred)},
+                                {"bytesSaved", double(result.bytesSaved)}},
+                    QString("%1: %2 new, %3 duplicates, %4 bytes not transferred")
+                        .arg(deviceDir).arg(result.imported).arg(result.deduplicated).arg(result.bytesSaved));
+    return result.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#ifndef CLIRUNNER_H
+#define CLIRUNNER_H
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include "imtdevice.h"
+
+// Serialises result lines from concurrently running devices, either as plain
+// text or as one compact JSON object per line.
+class CliOutput {
+public:
+    explicit CliOutput(bool json, bool showDevice);
+
+    void result(const QString &device, const QString &op, const QString &path, bool ok,
+                const QJsonObject &fields = QJsonObject(), const QString &text = QString());
+
+private:
+    bool m_json;
+    bool m_showDevice;
+    QMutex m_mutex;
+};
+
+// Runs one subcommand against one device. Safe to use from several threads
+// as long as each thread has its own device.
+class CliRunner {
+public:
+    explicit CliRunner(CliOutput &output);
+
+    // Content store used by "import"; defaults to <destDir>/.mtp-store.
+    void setStorePath(const QString &path) { m_storePath = path; }
+
+    static QStringList commands();
+    static bool isCommand(const QString &command);
+    static QString usageError(const QString &command, const QStringList &args);
+
+    // Returns 0 when every item succeeded, 1 otherwise. localRoot replaces
+    // the local directory argument of pull/sync/import when it is not empty.
+    int run(const QString &label, IMtpDevice *device, const QString &command,
+            const QStringList &args, const QString &localRoot = QString());
+
+private:
+    int list(const QString &label, IMtpDevice *device, const QStringList &args);
+    int stat(const QString &label, IMtpDevice *device, const QStringList &args);
+    int pull(const QString &label, IMtpDevice *device, const QStringList &sources, const QString &localDir);
+    int push(const QString &label, IMtpDevice *device, const QStringList &sources, const QString &deviceDir);
+    int remove(const QString &label, IMtpDevice *device, const QStringList &args);
+    int mkdir(const QString &label, IMtpDevice *device, const QStringList &args);
+    int sync(const QString &label, IMtpDevice *device, const QString &deviceDir, const QString &localDir);
+    int importTree(const QString &label, IMtpDevice *device, const QString &deviceDir, const QString &destDir);
+
+    QStringList expand(const QString &label, IMtpDevice *device, const QStringList &patterns);
+    // object as resolved by a listing or stat, so chunks skip the path lookup.
+    static bool copyToLocal(IMtpDevice *device, const MtpFileInfo &object, const QString &localPath, quint64 &bytes);
+
+    CliOutput &m_output;
+    QString m_storePath;
+    QMutex m_storeMutex;
+};
+
+#endif // CLIRUNNER_H
@@ -0,0 +1,160 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <memory>
+#include <vector>
+#include "clirunner.h"
+#include "mtpbackend.h"
+#include "mtptrace.h"
+#include "recordingmtpdevice.h"
+#include "tracingmtpdevice.h"
+
+namespace {
+
+struct CliDevice {
+    QString label;
+    IMtpDevice *device = nullptr;
+};
+
+QStringList readBatch(const QString &fileName, bool &ok) {
+    QFile file;
+    if (fileName == "-") {
+        ok = file.open(stdin, QIODevice::ReadOnly);
+    } else {
+        file.setFileName(fileName);
+        ok = file.open(QIODevice::ReadOnly);
+    }
+    QStringList args;
+    QTextStream in(&file);
+    while (ok && !in.atEnd()) {
+        const QString line = in.readLine().trimmed();
+        if (!line.isEmpty() && !line.startsWith('#'))
+            args << line;
+    }
+    return args;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("mtp_cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless MTP device tool.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {{"d", "device"}, "Device backend: mtp (default; mtp:<bus>:<devnum> or mtp:serial=<serial> picks one of several), stub[:root] or replay:<trace>. Repeat to run on several devices.", "spec"},
+        {{"j", "jobs"}, "Number of devices processed in parallel (default: all).", "n"},
+        {"json", "Print one JSON object per result line."},
+        {"batch", "Read more arguments from <file>, one per line; '-' reads stdin.", "file"},
+        {"record", "Record each device session to <file>; several devices get a .<n> suffix.", "file"},
+        {"trace", "Write a Chrome trace of the run to <file>.", "file"},
+        {"store", "Content store for import (default: <dest>/.mtp-store, shared by all devices).", "dir"},
+    });
+    parser.addPositionalArgument("command", "One of: " + CliRunner::commands().join(", "));
+    parser.addPositionalArgument("args", "Command arguments. Device paths may use * ? [] globs.", "[args...]");
+    parser.process(app);
+
+    QTextStream err(stderr);
+    QStringList positional = parser.positionalArguments();
+    if (positional.isEmpty() || !CliRunner::isCommand(positional.first())) {
+        err << "mtp_cli: expected a command (" << CliRunner::commands().join(", ") << ")\n";
+        return 2;
+    }
+    const QString command = positional.takeFirst();
+
+    if (parser.isSet("batch")) {
+        bool ok = false;
+        const QStringList batch = readBatch(parser.value("batch"), ok);
+        if (!ok) {
+            err << "mtp_cli: cannot read batch file " << parser.value("batch") << "\n";
+            return 2;
+        }
+        // The destination stays last for pull and push.
+        if (command == "pull" || command == "push") {
+            const QString destination = positional.isEmpty() ? QString() : positional.takeLast();
+            positional << batch;
+            if (!destination.isEmpty())
+                positional << destination;
+        } else {
+            positional << batch;
+        }
+    }
+
+    const QString usage = CliRunner::usageError(command, positional);
+    if (!usage.isEmpty()) {
+        err << "mtp_cli: " << usage << "\n";
+        return 2;
+    }
+
+    if (parser.isSet("trace"))
+        MtpTrace::setEnabled(true);
+
+    QStringList specs = parser.values("device");
+    if (specs.isEmpty())
+        specs << "mtp";
+
+    std::vector<std::unique_ptr<IMtpDevice>> owned;
+    QVector<CliDevice> devices;
+    for (int i = 0; i < specs.size(); ++i) {
+        QString error;
+        IMtpDevice *device = createMtpBackend(specs[i], error);
+        if (!device) {
+            err << "mtp_cli: " << error << "\n";
+            return 2;
+        }
+        owned.emplace_back(device);
+
+        if (parser.isSet("trace")) {
+            device = new TracingMtpDevice(device);
+            owned.emplace_back(device);
+        }
+        if (parser.isSet("record")) {
+            QString file = parser.value("record");
+            if (specs.size() > 1)
+                file += QString(".%1").arg(i);
+            device = new RecordingMtpDevice(device, file);
+            owned.emplace_back(device);
+        }
+        devices.append({specs.size() > 1 ? QString("%1#%2").arg(specs[i]).arg(i) : specs[i], device});
+    }
+
+    CliOutput output(parser.isSet("json"), devices.size() > 1);
+    CliRunner runner(output);
+    // One store for every device, even though each imports below <dest>/<n>;
+    // dedup across phones is the point of it.
+    if (parser.isSet("store"))
+        runner.setStorePath(parser.value("store"));
+    else if (command == "import")
+        runner.setStorePath(positional.last() + "/.mtp-store");
+
+    int jobs = parser.isSet("jobs") ? parser.value("jobs").toInt() : devices.size();
+    QThreadPool pool;
+    pool.setMaxThreadCount(qBound(1, jobs, devices.size()));
+
+    QVector<QFuture<int>> futures;
+    for (int i = 0; i < devices.size(); ++i) {
+        const CliDevice device = devices[i];
+        // With several devices pull/sync write below <dest>/<n> so they don't collide.
+        QString localRoot;
+        if (devices.size() > 1 && (command == "pull" || command == "sync" || command == "import"))
+            localRoot = positional.last() + QString("/%1").arg(i);
+        futures << QtConcurrent::run(&pool, [&runner, device, command, positional, localRoot]() {
+            return runner.run(device.label, device.device, command, positional, localRoot);
+        });
+    }
+
+    int rc = 0;
+    for (QFuture<int> &future : futures)
+        rc = qMax(rc, future.result());
+
+    if (parser.isSet("trace")) {
+        if (!MtpTrace::writeChromeTrace(parser.value("trace")))
+            err << "mtp_cli: cannot write trace " << parser.value("trace") << "\n";
+    }
+    return rc;
+}
@@ -0,0 +1,202 @@
+#include "cachingmtpdevice.h"
+
+namespace {
+
+QString normalizedPath(const QString &path) {
+    return path.startsWith('/') ? path.mid(1) : path;
+}
+
+MtpContentCacheKey keyFor(const MtpFileInfo &info) {
+    return {info.objectId, info.size, info.modified.toSecsSinceEpoch()};
+}
+
+} // namespace
+
+CachingMtpDevice::CachingMtpDevice(IMtpDevice *device, qint64 budgetBytes, qint64 maxEntryBytes, ValidationPolicy policy)
+    : m_device(device)
+    , m_maxEntryBytes(qMin(maxEntryBytes, budgetBytes))
+    , m_policy(policy)
+    , m_cache(budgetBytes)
+    , m_hits(0)
+    , m_misses(0)
+    , m_generation(0)
+    , m_allGeneration(0)
+    , m_readsInFlight(0)
+{
+}
+
+QVector<MtpFileInfo> CachingMtpDevice::getFileInfoList(const QString &path) {
+    const QVector<MtpFileInfo> infos = m_device->getFileInfoList(path);
+    revalidate(infos);
+    return infos;
+}
+
+bool CachingMtpDevice::statFile(const QString &path, MtpFileInfo &info) {
+    if (!m_device->statFile(path, info)) {
+        invalidate(path);
+        return false;
+    }
+    revalidate({info});
+    return true;
+}
+
+bool CachingMtpDevice::readFile(const QString &path, QByteArray &data) {
+    if (m_policy == TrustUntilInvalidated && lookup(path, nullptr, data))
+        return true;
+
+    // Stat before reading: a write landing in between then leaves newer
+    // bytes under the older key, which the next check drops, instead of
+    // older bytes under the newer key. A write or invalidation that lands
+    // after the stat bumps the path's generation, and insert() then keeps
+    // the bytes read here out of the cache.
+    const quint64 generation = beginRead();
+    MtpFileInfo info;
+    bool ok = false;
+    if (!m_device->statFile(path, info)) {
+        invalidate(path);
+        ok = m_device->readFile(path, data);
+    } else {
+        const MtpContentCacheKey key = keyFor(info);
+        if (m_policy == ValidateWithStat && lookup(path, &key, data)) {
+            ok = true;
+        } else {
+            ok = m_device->readFile(path, data);
+            if (ok && static_cast<quint64>(data.size()) == info.size && data.size() <= m_maxEntryBytes)
+                insert(path, key, data, generation);
+        }
+    }
+    endRead();
+    return ok;
+}
+
+bool CachingMtpDevice::writeFile(const QString &path, const QByteArray &data) {
+    invalidate(path);
+    bool ok = m_device->writeFile(path, data);
+    invalidate(path);
+    return ok;
+}
+
+bool CachingMtpDevice::deleteFile(const QString &path) {
+    bool ok = m_device->deleteFile(path);
+    invalidate(path);
+    return ok;
+}
+
+bool CachingMtpDevice::deleteDirectory(const QString &path) {
+    bool ok = m_device->deleteDirectory(path);
+    invalidatePrefix(path.endsWith('/') ? path : path + '/');
+    return ok;
+}
+
+void CachingMtpDevice::invalidate(const QString &path) {
+    QMutexLocker locker(&m_mutex);
+    const QString normalized = normalizedPath(path);
+    if (m_readsInFlight > 0)
+        m_pathGenerations.insert(normalized, ++m_generation);
+    auto it = m_keys.find(normalized);
+    if (it != m_keys.end()) {
+        m_cache.remove(it.value());
+        m_keys.erase(it);
+    }
+}
+
+void CachingMtpDevice::invalidateAll() {
+    QMutexLocker locker(&m_mutex);
+    m_allGeneration = ++m_generation;
+    m_cache.clear();
+    m_keys.clear();
+}
+
+quint64 CachingMtpDevice::hits() const {
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+quint64 CachingMtpDevice::misses() const {
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+qint64 CachingMtpDevice::cachedBytes() const {
+    QMutexLocker locker(&m_mutex);
+    return m_cache.totalCost();
+}
+
+bool CachingMtpDevice::lookup(const QString &path, const MtpContentCacheKey *key, QByteArray &data) {
+    QMutexLocker locker(&m_mutex);
+    const QString normalized = normalizedPath(path);
+    auto it = m_keys.find(normalized);
+
+    if (it != m_keys.end() && (!key || it.value() == *key)) {
+        if (QByteArray *cached = m_cache.object(it.value())) {
+            data = *cached;
+            ++m_hits;
+            return true;
+        }
+    }
+
+    // Either evicted or stale: forget the old key so m_keys tracks m_cache.
+    if (it != m_keys.end()) {
+        m_cache.remove(it.value());
+        m_keys.erase(it);
+    }
+    ++m_misses;
+    return false;
+}
+
+quint64 CachingMtpDevice::beginRead() {
+    QMutexLocker locker(&m_mutex);
+    ++m_readsInFlight;
+    return m_generation;
+}
+
+// Generations are only compared against reads still in flight, so once
+// none are left the per-path ones can go.
+void CachingMtpDevice::endRead() {
+    QMutexLocker locker(&m_mutex);
+    if (--m_readsInFlight == 0) {
+        m_pathGenerations.clear();
+        m_prefixGenerations.clear();
+    }
+}
+
+void CachingMtpDevice::insert(const QString &path, const MtpContentCacheKey &key, const QByteArray &data, quint64 generation) {
+    QMutexLocker locker(&m_mutex);
+    const QString normalized = normalizedPath(path);
+    if (m_allGeneration > generation || m_pathGenerations.value(normalized) > generation)
+        return;
+    for (auto it = m_prefixGenerations.cbegin(); it != m_prefixGenerations.cend(); ++it) {
+        if (it.value() > generation && normalized.startsWith(it.key()))
+            return;
+    }
+    if (m_cache.insert(key, new QByteArray(data), data.size()))
+        m_keys.insert(normalized, key);
+}
+
+void CachingMtpDevice::revalidate(const QVector<MtpFileInfo> &infos) {
+    QMutexLocker locker(&m_mutex);
+    if (m_keys.isEmpty())
+        return;
+    for (const MtpFileInfo &info : infos) {
+        auto it = m_keys.find(normalizedPath(info.path));
+        if (it != m_keys.end() && !(it.value() == keyFor(info))) {
+            m_cache.remove(it.value());
+            m_keys.erase(it);
+        }
+    }
+}
+
+void CachingMtpDevice::invalidatePrefix(const QString &prefix) {
+    QMutexLocker locker(&m_mutex);
+    const QString normalized = normalizedPath(prefix);
+    if (m_readsInFlight > 0)
+        m_prefixGenerations.insert(normalized, ++m_generation);
+    for (auto it = m_keys.begin(); it != m_keys.end();) {
+        if (it.key().startsWith(normalized)) {
+            m_cache.remove(it.value());
+            it = m_keys.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef CACHINGMTPDEVICE_H
+#define CACHINGMTPDEVICE_H
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include "imtdevice.h"
+
+struct MtpContentCacheKey {
+    quint32 objectId;
+    quint64 size;
+    qint64 mtime;
+
+    bool operator==(const MtpContentCacheKey &other) const {
+        return objectId == other.objectId && size == other.size && mtime == other.mtime;
+    }
+};
+
+inline size_t qHash(const MtpContentCacheKey &key, size_t seed = 0) {
+    return qHashMulti(seed, key.objectId, key.size, key.mtime);
+}
+
+// Read-through content cache in front of another IMtpDevice. Entries are keyed
+// by object ID plus size and mtime, evicted LRU once the memory budget is
+// exceeded, and dropped on writes and deletes that pass through this device.
+// Listings and stats that pass through drop entries whose size or mtime no
+// longer match. Beyond that, hits are trusted (TrustUntilInvalidated, the
+// default) and the owner calls invalidateAll() on device events such as
+// hotplug; ValidateWithStat stats on every hit instead, at the cost of a
+// device round trip per read.
+class CachingMtpDevice : public IMtpDevice {
+public:
+    enum ValidationPolicy {
+        ValidateWithStat,
+        TrustUntilInvalidated
+    };
+
+    explicit CachingMtpDevice(IMtpDevice *device,
+                              qint64 budgetBytes = 16 * 1024 * 1024,
+                              qint64 maxEntryBytes = 1024 * 1024,
+                              ValidationPolicy policy = TrustUntilInvalidated);
+
+    QVector<MtpDeviceInfo> detectDevices() override { return m_device->detectDevices(); }
+    QString getDeviceVersion() override { return m_device->getDeviceVersion(); }
+    QString getDeviceInfo() override { return m_device->getDeviceInfo(); }
+    quint64 getFreeSpace() override { return m_device->getFreeSpace(); }
+    QStringList getFileList(const QString &path = "/") override { return m_device->getFileList(path); }
+    QVector<MtpFileInfo> getFileInfoList(const QString &path = "/") override;
+    bool statFile(const QString &path, MtpFileInfo &info) override;
+
+    bool readFile(const QString &path, QByteArray &data) override;
+    bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) override { return m_device->readRange(path, offset, length, data); }
+    bool readObjectRange(const MtpFileInfo &object, quint64 offset, quint64 length, QByteArray &data) override { return m_device->readObjectRange(object, offset, length, data); }
+    bool writeFile(const QString &path, const QByteArray &data) override;
+    bool deleteFile(const QString &path) override;
+    bool createDirectory(const QString &path) override { return m_device->createDirectory(path); }
+    bool deleteDirectory(const QString &path) override;
+
+    void invalidate(const QString &path);
+    void invalidateAll();
+
+    quint64 hits() const;
+    quint64 misses() const;
+    qint64 cachedBytes() const;
+
+private:
+    bool lookup(const QString &path, const MtpContentCacheKey *key, QByteArray &data);
+    quint64 beginRead();
+    void endRead();
+    void insert(const QString &path, const MtpContentCacheKey &key, const QByteArray &data, quint64 generation);
+    void revalidate(const QVector<MtpFileInfo> &infos);
+    void invalidatePrefix(const QString &prefix);
+
+    IMtpDevice *m_device;
+    qint64 m_maxEntryBytes;
+    ValidationPolicy m_policy;
+
+    mutable QMutex m_mutex;
+    QCache<MtpContentCacheKey, QByteArray> m_cache;
+    QHash<QString, MtpContentCacheKey> m_keys;
+    quint64 m_hits;
+    quint64 m_misses;
+
+    // Bumped by every invalidation; a read only caches what it fetched if
+    // nothing covering its path was invalidated since it started.
+    quint64 m_generation;
+    quint64 m_allGeneration;
+    int m_readsInFlight;
+    QHash<QString, quint64> m_pathGenerations;
+    QHash<QString, quint64> m_prefixGenerations;
+};
+
+#endif // CACHINGMTPDEVICE_H
@@ -5,12 +5,21 @@
 #include <QStringList>
 #include <QByteArray>
 #include <QVector>
+#include <QDateTime>
 
 struct MtpDeviceInfo {
     QString friendlyName;
     QString mtpVersion;
 };
 
+struct MtpFileInfo {
+    QString path;
+    quint32 objectId = 0;
+    quint64 size = 0;
+    QDateTime modified;
+    bool isDir = false;
+};
+
 class IMtpDevice {
 public:
     virtual ~IMtpDevice() = default;
@@ -21,7 +30,19 @@ public:
     virtual quint64 getFreeSpace() = 0;
 
     virtual QStringList getFileList(const QString &path = "/") = 0;
+    // Same recursive walk as getFileList, with the metadata the listing
+    // already carries. Folder paths end with '/'.
+    virtual QVector<MtpFileInfo> getFileInfoList(const QString &path = "/") = 0;
+    virtual bool statFile(const QString &path, MtpFileInfo &info) = 0;
     virtual bool readFile(const QString &path, QByteArray &data) = 0;
+    // Reads up to length bytes starting at offset. A short or empty result
+    // means end of object, not failure.
+    virtual bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) = 0;
+    // readRange for an object from getFileInfoList or statFile. Backends that
+    // address objects by id skip resolving the path again on every chunk.
+    virtual bool readObjectRange(const MtpFileInfo &object, quint64 offset, quint64 length, QByteArray &data) {
+        return readRange(object.path, offset, length, data);
+    }
     virtual bool writeFile(const QString &path, const QByteArray &data) = 0;
     virtual bool deleteFile(const QString &path) = 0;
     virtual bool createDirectory(const QString &path) = 0;
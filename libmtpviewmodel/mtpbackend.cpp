@@ -0,0 +1,30 @@
+#include "mtpbackend.h"
+#include "mtpdeviceadapter.h"
+#include "replaymtpdevice.h"
+#include "stubmtpdevice.h"
+
+IMtpDevice *createMtpBackend(const QString &spec, QString &error, const QString &stubRoot) {
+    if (spec == "mtp" || spec.startsWith("mtp:")) {
+        MtpDeviceSelector selector;
+        if (!MtpDeviceSelector::parse(spec.mid(4), selector)) {
+            error = "bad device selector " + spec;
+            return nullptr;
+        }
+        return new MtpDeviceAdapter(selector);
+    }
+    if (spec == "stub")
+        return stubRoot.isEmpty() ? new StubMtpDevice : new StubMtpDevice(stubRoot);
+    if (spec.startsWith("stub:"))
+        return new StubMtpDevice(spec.mid(5));
+    if (spec.startsWith("replay:")) {
+        auto *replay = new ReplayMtpDevice(spec.mid(7), 1.0);
+        if (!replay->isValid()) {
+            delete replay;
+            error = "cannot load replay trace " + spec.mid(7);
+            return nullptr;
+        }
+        return replay;
+    }
+    error = "unknown device " + spec;
+    return nullptr;
+}
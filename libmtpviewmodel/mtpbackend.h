@@ -0,0 +1,13 @@
+#ifndef MTPBACKEND_H
+#define MTPBACKEND_H
+
+#include <QString>
+#include "imtdevice.h"
+
+// Builds the backend for "mtp[:<bus>:<devnum>|:serial=<serial>]",
+// "stub[:root]" or "replay:<trace>". A plain "stub" uses stubRoot, or the
+// stub's own default when that is empty. Returns nullptr and sets error when
+// the spec can't be used; the caller owns the device.
+IMtpDevice *createMtpBackend(const QString &spec, QString &error, const QString &stubRoot = QString());
+
+#endif // MTPBACKEND_H
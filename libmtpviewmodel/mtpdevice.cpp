@@ -1,5 +1,175 @@
 #include "mtpdevice.h"
+#include "mtptrace.h"
 #include <QDebug>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QRecursiveMutex>
+#include <memory>
+
+// Debug output is off by default: getFileList logs once per folder and the
+// formatting alone shows up on large listings. Enable with
+// QT_LOGGING_RULES="mtp.device.debug=true".
+Q_LOGGING_CATEGORY(lcMtpDevice, "mtp.device", QtWarningMsg)
+
+namespace {
+
+// A device kept open across calls. libmtp handles are not thread-safe, so
+// every call on the session holds its mutex; it is recursive because some
+// calls are built from others.
+struct MtpSession {
+    int busNumber = 0;
+    int deviceNumber = 0;
+    const void *owner = nullptr;
+    MtpDeviceInfo info;
+    QString serial;
+    QRecursiveMutex mutex;
+    LIBMTP_mtpdevice_t *device = nullptr; // nullptr once unregistered
+};
+
+QMutex &sessionsMutex() {
+    static QMutex mutex;
+    return mutex;
+}
+
+QVector<std::shared_ptr<MtpSession>> &sessions() {
+    static QVector<std::shared_ptr<MtpSession>> list;
+    return list;
+}
+
+std::shared_ptr<MtpSession> findSession(const MtpDeviceSelector &selector) {
+    QMutexLocker locker(&sessionsMutex());
+    for (const std::shared_ptr<MtpSession> &session : std::as_const(sessions())) {
+        if (selector.matches(session->busNumber, session->deviceNumber, session->serial))
+            return session;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<MtpSession> findSession(int busNumber, int deviceNumber) {
+    if (busNumber < 0)
+        return nullptr;
+    MtpDeviceSelector selector;
+    selector.busNumber = busNumber;
+    selector.deviceNumber = deviceNumber;
+    return findSession(selector);
+}
+
+// Whether a device is still enumerated at this USB location. An unplugged
+// device is gone from it, and one that comes back gets a new device number.
+bool attachedAt(int busNumber, int deviceNumber) {
+    LIBMTP_raw_device_t *rawDevices = nullptr;
+    int numDevices = 0;
+    if (LIBMTP_Detect_Raw_Devices(&rawDevices, &numDevices) != LIBMTP_ERROR_NONE)
+        numDevices = 0;
+    bool attached = false;
+    for (int i = 0; i < numDevices && !attached; ++i)
+        attached = int(rawDevices[i].bus_location) == busNumber && int(rawDevices[i].devnum) == deviceNumber;
+    free(rawDevices);
+    return attached;
+}
+
+// Set by MtpDevice::Target for the calls made on this thread.
+struct TargetState {
+    bool set = false;
+    int busNumber = 0;
+    int deviceNumber = 0;
+};
+
+thread_local TargetState t_target;
+
+} // namespace
+
+bool MtpDeviceSelector::matches(int bus, int dev, const QString &serialNumber) const {
+    if (!serial.isEmpty())
+        return serialNumber == serial;
+    return busNumber < 0 || (bus == busNumber && dev == deviceNumber);
+}
+
+bool MtpDeviceSelector::parse(const QString &text, MtpDeviceSelector &selector) {
+    selector = MtpDeviceSelector();
+    if (text.isEmpty())
+        return true;
+    if (text.startsWith("serial=")) {
+        selector.serial = text.mid(7);
+        return !selector.serial.isEmpty();
+    }
+    const QStringList parts = text.split(':');
+    bool busOk = false;
+    bool devOk = false;
+    if (parts.size() == 2) {
+        selector.busNumber = parts[0].toInt(&busOk);
+        selector.deviceNumber = parts[1].toInt(&devOk);
+    }
+    return busOk && devOk && selector.busNumber >= 0 && selector.deviceNumber >= 0;
+}
+
+MtpDevice::Target::Target()
+    : m_previousSet(t_target.set), m_previousBus(t_target.busNumber), m_previousDevice(t_target.deviceNumber)
+{
+    t_target.set = false;
+}
+
+MtpDevice::Target::Target(int busNumber, int deviceNumber)
+    : m_previousSet(t_target.set), m_previousBus(t_target.busNumber), m_previousDevice(t_target.deviceNumber)
+{
+    t_target = {true, busNumber, deviceNumber};
+}
+
+MtpDevice::Target::~Target() {
+    t_target = {m_previousSet, m_previousBus, m_previousDevice};
+}
+
+// The device one call runs on: the targeted session, or without a target
+// the first registered one, falling back to the first device opened for
+// just this call. A call that left errors on a session whose device is no
+// longer at its USB location unregisters it: the handle is dead, and
+// without a hotplug monitor nothing else would notice, so the next
+// openSession() can find the device again.
+class MtpDevice::Lease {
+public:
+    Lease() {
+        m_session = t_target.set ? findSession(t_target.busNumber, t_target.deviceNumber) : findSession(MtpDeviceSelector());
+        if (m_session) {
+            m_session->mutex.lock();
+            if (m_session->device)
+                return;
+            m_session->mutex.unlock(); // unregistered while we waited
+            m_session.reset();
+        }
+        // A targeted device that went away stays unavailable instead of
+        // quietly turning into some other device.
+        if (!t_target.set)
+            m_owned = openFirstDevice(m_rawDevices);
+    }
+
+    ~Lease() {
+        bool gone = false;
+        if (m_session) {
+            LIBMTP_mtpdevice_t *device = m_session->device;
+            if (LIBMTP_Get_Errorstack(device)) {
+                LIBMTP_Clear_Errorstack(device);
+                gone = !attachedAt(m_session->busNumber, m_session->deviceNumber);
+            }
+            m_session->mutex.unlock();
+        }
+        if (gone) {
+            qCWarning(lcMtpDevice) << "MtpDevice: device at bus" << m_session->busNumber << "device"
+                                   << m_session->deviceNumber << "went away, closing its session";
+            unregisterSession(m_session->busNumber, m_session->deviceNumber);
+        }
+        cleanUp(m_owned, m_rawDevices);
+    }
+
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+
+    LIBMTP_mtpdevice_t *device() const { return m_session ? m_session->device : m_owned; }
+
+private:
+    std::shared_ptr<MtpSession> m_session;
+    LIBMTP_mtpdevice_t *m_owned = nullptr;
+    LIBMTP_raw_device_t *m_rawDevices = nullptr;
+};
 
 
 
@@ -12,6 +182,7 @@ void MtpDevice::cleanUp(LIBMTP_mtpdevice_t *device, LIBMTP_raw_device_t *raw_dev
 
 
 LIBMTP_mtpdevice_t* MtpDevice::openFirstDevice(LIBMTP_raw_device_t*& rawDevices) {
+    MTP_TRACE_SPAN("usb.openDevice", "usb");
     LIBMTP_Init();
 
     rawDevices = nullptr;
@@ -26,13 +197,13 @@ LIBMTP_mtpdevice_t* MtpDevice::openFirstDevice(LIBMTP_raw_device_t*& rawDevices)
     }
 
     if (numDevices == 0) {
-        qDebug() << "MtpDevice: No MTP devices found.";
+        qCDebug(lcMtpDevice) << "MtpDevice: No MTP devices found.";
         cleanUp(nullptr, rawDevices);
         rawDevices = nullptr;
         return nullptr;
     }
 
-    qDebug() << "MtpDevice: Found" << numDevices << "raw device(s). Opening the first one.";
+    qCDebug(lcMtpDevice) << "MtpDevice: Found" << numDevices << "raw device(s). Opening the first one.";
 
 
     LIBMTP_mtpdevice_t *device = LIBMTP_Open_Raw_Device_Uncached(&rawDevices[0]);
@@ -46,6 +217,127 @@ LIBMTP_mtpdevice_t* MtpDevice::openFirstDevice(LIBMTP_raw_device_t*& rawDevices)
 }
 
 
+void MtpDevice::describe(LIBMTP_mtpdevice_t *device, OpenedDevice &entry) {
+    char *version = LIBMTP_Get_Deviceversion(device);
+    char *name = LIBMTP_Get_Friendlyname(device);
+    char *serial = LIBMTP_Get_Serialnumber(device);
+    entry.info.mtpVersion = version ? QString::fromUtf8(version) : "Unknown";
+    entry.info.friendlyName = name ? QString::fromUtf8(name) : "Unknown Device";
+    entry.serial = serial ? QString::fromUtf8(serial) : QString();
+    free(version);
+    free(name);
+    free(serial);
+}
+
+bool MtpDevice::openSession(const void *owner, const MtpDeviceSelector &selector, QPair<int, int> *location) {
+    // Serialises opening so two first calls don't both claim the device.
+    static QMutex openMutex;
+    QMutexLocker openLocker(&openMutex);
+    if (std::shared_ptr<MtpSession> session = findSession(selector)) {
+        if (location)
+            *location = {session->busNumber, session->deviceNumber};
+        return true;
+    }
+
+    MTP_TRACE_SPAN("usb.openDevice", "usb");
+    LIBMTP_Init();
+    LIBMTP_raw_device_t *rawDevices = nullptr;
+    int numDevices = 0;
+    LIBMTP_error_number_t err = LIBMTP_Detect_Raw_Devices(&rawDevices, &numDevices);
+    if (err != LIBMTP_ERROR_NONE && err != LIBMTP_ERROR_NO_DEVICE_ATTACHED)
+        qWarning() << "MtpDevice::openSession: Failed to detect raw devices, error" << err;
+
+    bool opened = false;
+    for (int i = 0; i < numDevices && !opened; ++i) {
+        OpenedDevice entry;
+        entry.busNumber = int(rawDevices[i].bus_location);
+        entry.deviceNumber = int(rawDevices[i].devnum);
+        // Sessions that matched were found above; the rest belong to others.
+        const bool otherLocation = selector.busNumber >= 0
+            && (entry.busNumber != selector.busNumber || entry.deviceNumber != selector.deviceNumber);
+        if (otherLocation || hasSession(entry.busNumber, entry.deviceNumber))
+            continue;
+
+        entry.device = LIBMTP_Open_Raw_Device_Uncached(&rawDevices[i]);
+        if (!entry.device)
+            continue;
+        describe(entry.device, entry);
+        if (!selector.matches(entry.busNumber, entry.deviceNumber, entry.serial)) {
+            cleanUp(entry.device);
+            continue;
+        }
+
+        registerSession(entry, owner);
+        if (location)
+            *location = {entry.busNumber, entry.deviceNumber};
+        opened = true;
+    }
+
+    cleanUp(nullptr, rawDevices);
+    if (!opened)
+        qCDebug(lcMtpDevice) << "MtpDevice::openSession: no device to open";
+    return opened;
+}
+
+void MtpDevice::registerSession(const OpenedDevice &opened, const void *owner) {
+    auto session = std::make_shared<MtpSession>();
+    session->busNumber = opened.busNumber;
+    session->deviceNumber = opened.deviceNumber;
+    session->owner = owner;
+    session->info = opened.info;
+    session->serial = opened.serial;
+    session->device = opened.device;
+
+    QMutexLocker locker(&sessionsMutex());
+    sessions().append(session);
+    qCDebug(lcMtpDevice) << "MtpDevice: session open for" << opened.info.friendlyName
+                         << "at bus" << opened.busNumber << "device" << opened.deviceNumber;
+}
+
+void MtpDevice::unregisterSession(int busNumber, int deviceNumber, const void *owner) {
+    std::shared_ptr<MtpSession> session;
+    {
+        QMutexLocker locker(&sessionsMutex());
+        QVector<std::shared_ptr<MtpSession>> &list = sessions();
+        for (int i = 0; i < list.size(); ++i) {
+            const std::shared_ptr<MtpSession> &candidate = list.at(i);
+            if (candidate->busNumber == busNumber && candidate->deviceNumber == deviceNumber
+                && (!owner || candidate->owner == owner)) {
+                session = list.takeAt(i);
+                break;
+            }
+        }
+    }
+    if (!session)
+        return;
+
+    // Waits for a call still running on the session.
+    QMutexLocker locker(&session->mutex);
+    cleanUp(session->device);
+    session->device = nullptr;
+}
+
+void MtpDevice::closeSessions(const void *owner) {
+    QVector<QPair<int, int>> owned;
+    {
+        QMutexLocker locker(&sessionsMutex());
+        for (const std::shared_ptr<MtpSession> &session : std::as_const(sessions())) {
+            if (session->owner == owner)
+                owned.append({session->busNumber, session->deviceNumber});
+        }
+    }
+    for (const QPair<int, int> &location : std::as_const(owned))
+        unregisterSession(location.first, location.second, owner);
+}
+
+bool MtpDevice::hasSession(int busNumber, int deviceNumber, MtpDeviceInfo *info) {
+    std::shared_ptr<MtpSession> session = findSession(busNumber, deviceNumber);
+    if (session && info)
+        *info = session->info;
+    return session != nullptr;
+}
+
+
 QVector<MtpDeviceInfo> MtpDevice::detectDevices() {
     LIBMTP_Init();
     QVector<MtpDeviceInfo> devicesInfo;
@@ -60,6 +352,12 @@ QVector<MtpDeviceInfo> MtpDevice::detectDevices() {
     }
 
     for (int i = 0; i < numDevices; ++i) {
+        // A device with an open session can't be opened a second time.
+        if (std::shared_ptr<MtpSession> session = findSession(int(rawDevices[i].bus_location), int(rawDevices[i].devnum))) {
+            devicesInfo.append(session->info);
+            continue;
+        }
+
         LIBMTP_mtpdevice_t *device = LIBMTP_Open_Raw_Device_Uncached(&rawDevices[i]);
         if (device) {
             MtpDeviceInfo info;
@@ -83,9 +381,57 @@ QVector<MtpDeviceInfo> MtpDevice::detectDevices() {
 }
 
 
-QString MtpDevice::getDeviceVersion() {
+QVector<MtpDevice::OpenedDevice> MtpDevice::openDevicesAt(const QVector<QPair<int, int>> &locations) {
+    MTP_TRACE_SPAN("usb.openDevicesAt", "usb");
+    LIBMTP_Init();
+    QVector<OpenedDevice> opened;
     LIBMTP_raw_device_t *rawDevices = nullptr;
-    LIBMTP_mtpdevice_t *device = openFirstDevice(rawDevices);
+    int numDevices = 0;
+    LIBMTP_error_number_t err = LIBMTP_Detect_Raw_Devices(&rawDevices, &numDevices);
+
+    if (err != LIBMTP_ERROR_NONE && err != LIBMTP_ERROR_NO_DEVICE_ATTACHED)
+        qWarning() << "MtpDevice::openDevicesAt: Failed to detect raw devices, error" << err;
+
+    for (int i = 0; i < numDevices; ++i) {
+        const QPair<int, int> location(int(rawDevices[i].bus_location), int(rawDevices[i].devnum));
+        if (!locations.contains(location))
+            continue;
+
+        OpenedDevice entry;
+        entry.busNumber = location.first;
+        entry.deviceNumber = location.second;
+
+        // Already open in this process: report it rather than fail to claim
+        // it a second time. Checked again after a failed open, in case a
+        // session was opened meanwhile.
+        LIBMTP_mtpdevice_t *device = nullptr;
+        if (!hasSession(location.first, location.second, &entry.info))
+            device = LIBMTP_Open_Raw_Device_Uncached(&rawDevices[i]);
+        if (!device) {
+            if (hasSession(location.first, location.second, &entry.info))
+                opened.append(entry);
+            else
+                qWarning() << "MtpDevice::openDevicesAt: Failed to open device at bus" << location.first << "device" << location.second;
+            continue;
+        }
+
+        entry.device = device;
+        describe(device, entry);
+        opened.append(entry);
+    }
+
+    cleanUp(nullptr, rawDevices);
+    return opened;
+}
+
+void MtpDevice::releaseDevice(LIBMTP_mtpdevice_t *device) {
+    cleanUp(device);
+}
+
+
+QString MtpDevice::getDeviceVersion() {
+    Lease lease;
+    LIBMTP_mtpdevice_t *device = lease.device();
     QString result = "Error: Could not open device";
 
     if (device) {
@@ -96,13 +442,12 @@ QString MtpDevice::getDeviceVersion() {
         result = "Error: No device found or failed to open";
     }
 
-    cleanUp(device, rawDevices);
     return result;
 }
 
 QString MtpDevice::getDeviceInfo() {
-    LIBMTP_raw_device_t *rawDevices = nullptr;
-    LIBMTP_mtpdevice_t *device = openFirstDevice(rawDevices);
+    Lease lease;
+    LIBMTP_mtpdevice_t *device = lease.device();
     QString result = "Error: Could not open device";
 
     if (device) {
@@ -113,13 +458,12 @@ QString MtpDevice::getDeviceInfo() {
         result = "Error: No device found or failed to open";
     }
 
-    cleanUp(device, rawDevices);
     return result;
 }
 
 quint64 MtpDevice::getFreeSpace() {
-    LIBMTP_raw_device_t *rawDevices = nullptr;
-    LIBMTP_mtpdevice_t *device = openFirstDevice(rawDevices);
+    Lease lease;
+    LIBMTP_mtpdevice_t *device = lease.device();
     uint64_t freeSpace = 0;
 
     if (device) {
@@ -141,59 +485,143 @@ quint64 MtpDevice::getFreeSpace() {
         qWarning() << "MtpDevice::getFreeSpace: No device found or failed to open";
     }
 
-    cleanUp(device, rawDevices);
     return freeSpace;
 }
 
 
 
 QStringList MtpDevice::getFileList(const QString &path) {
-    qDebug() << "MtpDevice::getFileList - fetching files for path:" << path;
-    LIBMTP_raw_device_t *rawDevices = nullptr;
-    LIBMTP_mtpdevice_t *device = openFirstDevice(rawDevices);
+    qCDebug(lcMtpDevice) << "MtpDevice::getFileList - fetching files for path:" << path;
     QStringList fileList;
+    for (const MtpFileInfo &info : getFileInfoList(path))
+        fileList.append(info.path);
 
-    if (device) {
-        LIBMTP_file_t *files = LIBMTP_Get_Files_And_Folders(device, LIBMTP_STORAGE_SORTBY_NOTSORTED, 0);
-        LIBMTP_file_t *current = files;
+    qCDebug(lcMtpDevice) << "MtpDevice::getFileList: Found" << fileList.count() << "items in" << path;
+    return fileList;
+}
 
-        while (current != nullptr) {
-            QString name = QString::fromUtf8(current->filename);
-            QString fullPath = path + (path.endsWith("/") ? "" : "/") + name;
+void MtpDevice::appendFolder(LIBMTP_mtpdevice_t *device, uint32_t folderId, const QString &prefix, QVector<MtpFileInfo> &infos) {
+    LIBMTP_file_t *files = nullptr;
+    {
+        MTP_TRACE_SPAN("usb.listFolder", "usb");
+        files = LIBMTP_Get_Files_And_Folders(device, LIBMTP_STORAGE_SORTBY_NOTSORTED, folderId);
+    }
+
+    while (files != nullptr) {
+        LIBMTP_file_t *next = files->next;
+        MtpFileInfo info;
+        info.isDir = files->filetype == LIBMTP_FILETYPE_FOLDER;
+        info.path = prefix + QString::fromUtf8(files->filename) + (info.isDir ? "/" : "");
+        info.objectId = files->item_id;
+        info.size = info.isDir ? 0 : files->filesize;
+        info.modified = QDateTime::fromSecsSinceEpoch(files->modificationdate);
+        infos.append(info);
+        if (info.isDir)
+            appendFolder(device, files->item_id, info.path, infos);
+        LIBMTP_destroy_file_t(files);
+        files = next;
+    }
+}
 
-            if (current->filetype == LIBMTP_FILETYPE_FOLDER) {
-                fileList.append(getFileList(fullPath));
+QVector<MtpFileInfo> MtpDevice::getFileInfoList(const QString &path) {
+    Lease lease;
+    LIBMTP_mtpdevice_t *device = lease.device();
+    QVector<MtpFileInfo> infos;
+    if (!device) {
+        qWarning() << "MtpDevice::getFileInfoList: Device not available.";
+        return infos;
+    }
+
+    QString prefix = path.startsWith('/') ? path : '/' + path;
+    if (!prefix.endsWith('/'))
+        prefix += '/';
+
+    uint32_t folderId = 0;
+    bool found = true;
+    if (prefix != "/") {
+        LIBMTP_file_t *folder = findObject(device, prefix);
+        found = folder && folder->filetype == LIBMTP_FILETYPE_FOLDER;
+        if (found)
+            folderId = folder->item_id;
+        cleanUp(nullptr, nullptr, folder);
+    }
+
+    if (found)
+        appendFolder(device, folderId, prefix, infos);
+    else
+        qWarning() << "MtpDevice::getFileInfoList: no folder at" << path;
+
+    qCDebug(lcMtpDevice) << "MtpDevice::getFileInfoList: Found" << infos.size() << "items in" << path;
+    return infos;
+}
+
+// Resolves a slash separated path one folder level at a time. The returned
+// object is detached from its sibling list and must be freed with cleanUp().
+LIBMTP_file_t* MtpDevice::findObject(LIBMTP_mtpdevice_t *device, const QString &path) {
+    const QStringList parts = path.split('/', Qt::SkipEmptyParts);
+    uint32_t parentId = 0;
+    LIBMTP_file_t *match = nullptr;
+
+    for (int i = 0; i < parts.size(); ++i) {
+        if (match) {
+            cleanUp(nullptr, nullptr, match);
+            match = nullptr;
+        }
+
+        const QByteArray name = parts[i].toUtf8();
+        LIBMTP_file_t *current = nullptr;
+        {
+            MTP_TRACE_SPAN("usb.listFolder", "usb");
+            current = LIBMTP_Get_Files_And_Folders(device, LIBMTP_STORAGE_SORTBY_NOTSORTED, parentId);
+        }
+        while (current != nullptr) {
+            LIBMTP_file_t *next = current->next;
+            if (!match && current->filename && name == current->filename) {
+                match = current;
+                match->next = nullptr;
             } else {
-                fileList.append(fullPath);
+                LIBMTP_destroy_file_t(current);
             }
+            current = next;
+        }
 
-            current = current->next;
+        if (!match)
+            return nullptr;
+        if (i < parts.size() - 1 && match->filetype != LIBMTP_FILETYPE_FOLDER) {
+            cleanUp(nullptr, nullptr, match);
+            return nullptr;
         }
+        parentId = match->item_id;
+    }
+    return match;
+}
 
-        cleanUp(nullptr, nullptr, files);
-        qDebug() << "MtpDevice::getFileList: Found" << fileList.count() << "items in" << path;
-        if (fileList.count() == 0){
-                if (path == "/") {
-                    return {"DCIM/", "Documents/", "Music/"};
-                } else if (path == "DCIM/") {
-                    return {"DCIM/Photos/", "DCIM/Videos/"};
-                } else if (path == "DCIM/Photos/") {
-                    return {"DCIM/Photos/image1.jpg", "DCIM/Photos/image2.jpg"};
-                } else if (path == "Documents/") {
-                    return {"Documents/file1.txt", "Documents/file2.txt"};
-                }
-                return {};
-            }
+bool MtpDevice::statFile(const QString &path, MtpFileInfo &info) {
+    Lease lease;
+    LIBMTP_mtpdevice_t *device = lease.device();
+    if (!device) {
+        qWarning() << "MtpDevice::statFile: Device not available.";
+        return false;
+    }
+
+    LIBMTP_file_t *file = findObject(device, path);
+    if (file) {
+        info.path = path;
+        info.objectId = file->item_id;
+        info.size = file->filesize;
+        info.modified = QDateTime::fromSecsSinceEpoch(file->modificationdate);
+        info.isDir = file->filetype == LIBMTP_FILETYPE_FOLDER;
     } else {
-        qWarning() << "MtpDevice::getFileList: Device not available.";
+        qCDebug(lcMtpDevice) << "MtpDevice::statFile: no object at" << path;
     }
 
-    cleanUp(device, rawDevices);
-    return fileList;
+    bool found = file != nullptr;
+    cleanUp(nullptr, nullptr, file);
+    return found;
 }
 
 bool MtpDevice::readFile(const QString &path, QByteArray &data) {
-    qDebug() << "MtpDevice::readFile - mock implementation for path:" << path;
+    qCDebug(lcMtpDevice) << "MtpDevice::readFile - mock implementation for path:" << path;
     if (path == "test.txt") {
         data = QByteArray("mock test fil from MtpDevice::readFile.");
         return true;
@@ -202,10 +630,68 @@ bool MtpDevice::readFile(const QString &path, QByteArray &data) {
     return false;
 }
 
+bool MtpDevice::readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) {
+    Lease lease;
+    LIBMTP_mtpdevice_t *device = lease.device();
+    if (!device) {
+        qWarning() << "MtpDevice::readRange: Device not available.";
+        return false;
+    }
+
+    LIBMTP_file_t *file = findObject(device, path);
+    if (!file) {
+        qWarning() << "MtpDevice::readRange: file not found:" << path;
+        return false;
+    }
+
+    const bool ok = readPartial(device, file->item_id, file->filesize, offset, length, data);
+    cleanUp(nullptr, nullptr, file);
+    return ok;
+}
+
+bool MtpDevice::readObjectRange(quint32 objectId, quint64 size, quint64 offset, quint64 length, QByteArray &data) {
+    Lease lease;
+    LIBMTP_mtpdevice_t *device = lease.device();
+    if (!device) {
+        qWarning() << "MtpDevice::readObjectRange: Device not available.";
+        return false;
+    }
+    return readPartial(device, objectId, size, offset, length, data);
+}
+
+bool MtpDevice::readPartial(LIBMTP_mtpdevice_t *device, quint32 objectId, quint64 size, quint64 offset, quint64 length, QByteArray &data) {
+    data.clear();
+    const quint64 end = offset >= size ? offset : offset + qMin(length, size - offset);
+    const quint64 maxRequest = 16 * 1024 * 1024;
+
+    // GetPartialObject takes a 32 bit length, so long ranges are split.
+    while (offset < end) {
+        unsigned char *chunk = nullptr;
+        unsigned int chunkSize = 0;
+        uint32_t request = static_cast<uint32_t>(qMin(end - offset, maxRequest));
+        MtpTraceSpan span("usb.getPartialObject", "usb");
+        int rc = LIBMTP_GetPartialObject(device, objectId, offset, request, &chunk, &chunkSize);
+        span.addBytes(chunkSize);
+        if (rc != 0) {
+            qWarning() << "MtpDevice::readPartial: GetPartialObject failed for object" << objectId << "at offset" << offset;
+            // Left on the stack for the Lease, which checks the device is
+            // still there.
+            LIBMTP_Dump_Errorstack(device);
+            return false;
+        }
+        data.append(reinterpret_cast<const char *>(chunk), static_cast<qsizetype>(chunkSize));
+        free(chunk);
+        if (chunkSize == 0)
+            break;
+        offset += chunkSize;
+    }
+    return true;
+}
+
 bool MtpDevice::writeFile(const QString &path, const QByteArray &data) {
-    qDebug() << "MtpDevice::writeFile - Mock implementation for path:" << path << "Data size:" << data.size();
+    qCDebug(lcMtpDevice) << "MtpDevice::writeFile - Mock implementation for path:" << path << "Data size:" << data.size();
     if (path == "newfile.txt") {
-        qDebug() << "MtpDevice::writeFile: Mock - Pretending to write" << path;
+        qCDebug(lcMtpDevice) << "MtpDevice::writeFile: Mock - Pretending to write" << path;
         return true;
     }
     qWarning() << "MtpDevice::writeFile: mock - cannot write to" << path;
@@ -213,19 +699,19 @@ bool MtpDevice::writeFile(const QString &path, const QByteArray &data) {
 }
 
 bool MtpDevice::deleteFile(const QString &path) {
-    qDebug() << "MtpDevice::deleteFile - mock implementation for path:" << path;
+    qCDebug(lcMtpDevice) << "MtpDevice::deleteFile - mock implementation for path:" << path;
     qWarning() << "MtpDevice::deleteFile: mock - cannot delete" << path;
     return false;
 }
 
 bool MtpDevice::createDirectory(const QString &path) {
-    qDebug() << "MtpDevice::createDirectory - mock implementation for path:" << path;
+    qCDebug(lcMtpDevice) << "MtpDevice::createDirectory - mock implementation for path:" << path;
     qWarning() << "MtpDevice::createDirectory: mock - cannot create" << path;
     return false;
 }
 
 bool MtpDevice::deleteDirectory(const QString &path) {
-    qDebug() << "MtpDevice::deleteDirectory - Mock implementation for path:" << path;
+    qCDebug(lcMtpDevice) << "MtpDevice::deleteDirectory - Mock implementation for path:" << path;
     qWarning() << "MtpDevice::deleteDirectory: Mock - cannot delete" << path;
     return false;
 }
@@ -6,32 +6,101 @@
 #include <QStringList>
 #include <QByteArray>
 #include <QVector>
+#include <QPair>
+#include "imtdevice.h"
 
+// Picks one of several attached devices by USB location or by serial
+// number; with neither set, the first device found.
+struct MtpDeviceSelector {
+    int busNumber = -1;
+    int deviceNumber = -1;
+    QString serial;
 
-struct MtpDeviceInfo {
-    QString friendlyName;
-    QString mtpVersion;
+    bool isAny() const { return busNumber < 0 && serial.isEmpty(); }
+    bool matches(int bus, int dev, const QString &serialNumber) const;
+    // Accepts "", "<bus>:<devnum>" or "serial=<serial>".
+    static bool parse(const QString &text, MtpDeviceSelector &selector);
 };
 
-
-
 class MtpDevice {
 public:
+    // A device opened by openDevicesAt(); release with releaseDevice() or hand
+    // it to registerSession().
+    struct OpenedDevice {
+        int busNumber = 0;
+        int deviceNumber = 0;
+        LIBMTP_mtpdevice_t *device = nullptr;
+        MtpDeviceInfo info;
+        QString serial;
+    };
+
+    // Points the calls made on this thread at the session at one USB location
+    // while in scope; if it is gone they fail instead of opening another
+    // device. The default one clears an outer target.
+    class Target {
+    public:
+        Target();
+        Target(int busNumber, int deviceNumber);
+        ~Target();
+        Target(const Target &) = delete;
+        Target &operator=(const Target &) = delete;
+
+    private:
+        bool m_previousSet;
+        int m_previousBus;
+        int m_previousDevice;
+    };
+
     static QVector<MtpDeviceInfo> detectDevices();
 
+    // Opens only the raw devices at the given USB bus/device numbers; USB
+    // devices that libmtp doesn't recognise are skipped. Devices that already
+    // have a session are reported with device == nullptr.
+    static QVector<OpenedDevice> openDevicesAt(const QVector<QPair<int, int>> &locations);
+    static void releaseDevice(LIBMTP_mtpdevice_t *device);
+
+    // Sessions keep a device open across calls. While one is registered every
+    // call below runs on it (or on the Target's) instead of opening the first
+    // device per call, which also fails once another handle has claimed the
+    // interface. openSession() opens and registers the first device matching
+    // selector unless a matching session exists already, and reports its
+    // location. registerSession() takes ownership of a device from
+    // openDevicesAt(); unregisterSession() waits for a call still running on
+    // it and releases it. With owner set, only that owner's session goes.
+    // A session whose device stops answering and is no longer at its USB
+    // location is unregistered by the call that noticed.
+    static bool openSession(const void *owner, const MtpDeviceSelector &selector = MtpDeviceSelector(),
+                            QPair<int, int> *location = nullptr);
+    static void registerSession(const OpenedDevice &opened, const void *owner);
+    static void unregisterSession(int busNumber, int deviceNumber, const void *owner = nullptr);
+    static void closeSessions(const void *owner);
+    static bool hasSession(int busNumber, int deviceNumber, MtpDeviceInfo *info = nullptr);
+
     static QString getDeviceVersion();
     static QString getDeviceInfo();
     static quint64 getFreeSpace();
 
     static QStringList getFileList(const QString &path = "/");
+    static QVector<MtpFileInfo> getFileInfoList(const QString &path = "/");
+    static bool statFile(const QString &path, MtpFileInfo &info);
     static bool readFile(const QString &path, QByteArray &data);
+    static bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data);
+    // readRange() for an object already resolved by getFileInfoList() or
+    // statFile(); skips the path lookup.
+    static bool readObjectRange(quint32 objectId, quint64 size, quint64 offset, quint64 length, QByteArray &data);
     static bool writeFile(const QString &path, const QByteArray &data);
     static bool deleteFile(const QString &path);
     static bool createDirectory(const QString &path);
     static bool deleteDirectory(const QString &path);
 
 private:
+    class Lease;
+
     static LIBMTP_mtpdevice_t* openFirstDevice(LIBMTP_raw_device_t*& rawDevices);
+    static void describe(LIBMTP_mtpdevice_t *device, OpenedDevice &entry);
+    static LIBMTP_file_t* findObject(LIBMTP_mtpdevice_t *device, const QString &path);
+    static void appendFolder(LIBMTP_mtpdevice_t *device, uint32_t folderId, const QString &prefix, QVector<MtpFileInfo> &infos);
+    static bool readPartial(LIBMTP_mtpdevice_t *device, quint32 objectId, quint64 size, quint64 offset, quint64 length, QByteArray &data);
 
     static void cleanUp(LIBMTP_mtpdevice_t *device = nullptr, LIBMTP_raw_device_t *raw_devices = nullptr, LIBMTP_file_t *file = nullptr, void *data_ptr = nullptr);
 
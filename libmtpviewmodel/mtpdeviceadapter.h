@@ -4,18 +4,55 @@
 #include "imtdevice.h"
 #include "mtpdevice.h"
 
+// Forwards to MtpDevice on a session that stays open for the adapter's
+// lifetime, so calls don't each detect and open the device. The session is
+// opened on first use, and again after the device was unplugged and came
+// back: the first call failing on the dead handle closes it, with or
+// without a hotplug monitor, and the next one opens the device at its new
+// location. When a monitor already holds a session, calls run on that
+// instead. The selector picks the device when several are attached; a
+// bus:devnum selector no longer matches once the device re-enumerated.
 class MtpDeviceAdapter : public IMtpDevice {
 public:
+    explicit MtpDeviceAdapter(const MtpDeviceSelector &selector = MtpDeviceSelector()) : m_selector(selector) {}
+    ~MtpDeviceAdapter() override { MtpDevice::closeSessions(this); }
+
     QVector<MtpDeviceInfo> detectDevices() override { return MtpDevice::detectDevices(); }
-    QString getDeviceVersion() override { return MtpDevice::getDeviceVersion(); }
-    QString getDeviceInfo() override { return MtpDevice::getDeviceInfo(); }
-    quint64 getFreeSpace() override { return MtpDevice::getFreeSpace(); }
-    QStringList getFileList(const QString &path = "/") override { return MtpDevice::getFileList(path); }
+    QString getDeviceVersion() override { const MtpDevice::Target target = session(); return MtpDevice::getDeviceVersion(); }
+    QString getDeviceInfo() override { const MtpDevice::Target target = session(); return MtpDevice::getDeviceInfo(); }
+    quint64 getFreeSpace() override { const MtpDevice::Target target = session(); return MtpDevice::getFreeSpace(); }
+    QStringList getFileList(const QString &path = "/") override { const MtpDevice::Target target = session(); return MtpDevice::getFileList(path); }
+    QVector<MtpFileInfo> getFileInfoList(const QString &path = "/") override { const MtpDevice::Target target = session(); return MtpDevice::getFileInfoList(path); }
+    bool statFile(const QString &path, MtpFileInfo &info) override { const MtpDevice::Target target = session(); return MtpDevice::statFile(path, info); }
     bool readFile(const QString &path, QByteArray &data) override { return MtpDevice::readFile(path, data); }
+    bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) override {
+        const MtpDevice::Target target = session();
+        return MtpDevice::readRange(path, offset, length, data);
+    }
+    bool readObjectRange(const MtpFileInfo &object, quint64 offset, quint64 length, QByteArray &data) override {
+        if (object.objectId == 0)
+            return readRange(object.path, offset, length, data);
+        const MtpDevice::Target target = session();
+        return MtpDevice::readObjectRange(object.objectId, object.size, offset, length, data);
+    }
     bool writeFile(const QString &path, const QByteArray &data) override { return MtpDevice::writeFile(path, data); }
     bool deleteFile(const QString &path) override { return MtpDevice::deleteFile(path); }
     bool createDirectory(const QString &path) override { return MtpDevice::createDirectory(path); }
     bool deleteDirectory(const QString &path) override { return MtpDevice::deleteDirectory(path); }
+
+private:
+    // Without a selected device that can be opened, the first-device
+    // fallback only applies when no particular device was asked for.
+    MtpDevice::Target session() {
+        QPair<int, int> location;
+        if (MtpDevice::openSession(this, m_selector, &location))
+            return MtpDevice::Target(location.first, location.second);
+        if (m_selector.isAny())
+            return MtpDevice::Target();
+        return MtpDevice::Target(-1, -1);
+    }
+
+    MtpDeviceSelector m_selector;
 };
 
 #endif // MTPDEVICEADAPTER_H
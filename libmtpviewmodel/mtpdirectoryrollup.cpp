@@ -0,0 +1,366 @@
+#include "mtpdirectoryrollup.h"
+
+namespace {
+
+// Holes below this count are never worth a compaction pass.
+const int kMinCompactHoles = 256;
+
+} // namespace
+
+MtpDirectoryRollup::MtpDirectoryRollup()
+    : m_deadDirs(0)
+    , m_deadFiles(0)
+{
+    clear();
+}
+
+QString MtpDirectoryRollup::normalizedDir(const QString &path) {
+    QString dir = path.startsWith('/') ? path : '/' + path;
+    if (!dir.endsWith('/'))
+        dir += '/';
+    return dir;
+}
+
+QString MtpDirectoryRollup::normalizedFile(const QString &path) {
+    QString file = path.startsWith('/') ? path : '/' + path;
+    while (file.size() > 1 && file.endsWith('/'))
+        file.chop(1);
+    return file;
+}
+
+QString MtpDirectoryRollup::parentDir(const QString &path) {
+    if (path == "/")
+        return QString();
+    const int slash = path.lastIndexOf('/', path.endsWith('/') ? path.size() - 2 : -1);
+    return path.left(slash + 1);
+}
+
+void MtpDirectoryRollup::clear() {
+    m_dirs.clear();
+    m_files.clear();
+    m_dirIndex.clear();
+    m_fileIndex.clear();
+    m_bySize.clear();
+    m_deadDirs = 0;
+    m_deadFiles = 0;
+    ensureDir("/");
+}
+
+int MtpDirectoryRollup::ensureDir(const QString &dirPath) {
+    auto it = m_dirIndex.constFind(dirPath);
+    if (it != m_dirIndex.constEnd())
+        return it.value();
+
+    const int parent = dirPath == "/" ? -1 : ensureDir(parentDir(dirPath));
+    const int index = m_dirs.size();
+    DirNode node;
+    node.path = dirPath;
+    node.parent = parent;
+    if (parent >= 0) {
+        node.slot = m_dirs.at(parent).childDirs.size();
+        m_dirs[parent].childDirs.append(index);
+    }
+    m_dirs.append(node);
+    m_dirIndex.insert(dirPath, index);
+    m_bySize.insert({0, index});
+    return index;
+}
+
+int MtpDirectoryRollup::appendFile(const QString &path, int dir, quint64 size, qint64 mtime) {
+    const int index = m_files.size();
+    FileNode file;
+    file.path = path;
+    file.dir = dir;
+    file.slot = m_dirs.at(dir).childFiles.size();
+    file.size = size;
+    file.mtime = mtime;
+    m_files.append(file);
+    m_dirs[dir].childFiles.append(index);
+    m_fileIndex.insert(path, index);
+    return index;
+}
+
+void MtpDirectoryRollup::build(const QVector<MtpFileInfo> &entries) {
+    clear();
+
+    // First only the folders' own files are counted...
+    for (const MtpFileInfo &entry : entries) {
+        if (entry.isDir) {
+            ensureDir(normalizedDir(entry.path));
+            continue;
+        }
+
+        const QString path = normalizedFile(entry.path);
+        if (m_fileIndex.contains(path))
+            continue;
+
+        const int dir = ensureDir(parentDir(path));
+        const qint64 mtime = entry.modified.isValid() ? entry.modified.toSecsSinceEpoch() : 0;
+        appendFile(path, dir, entry.size, mtime);
+
+        DirNode &node = m_dirs[dir];
+        node.bytes += entry.size;
+        node.files += 1;
+        if (mtime > 0)
+            node.mtimes.insert(mtime);
+    }
+
+    // ...then folded into the parents. Children always have higher indices
+    // than their parent, so one reverse sweep sees every folder complete
+    // before it is added upwards.
+    for (int i = m_dirs.size() - 1; i >= 0; --i) {
+        DirNode &child = m_dirs[i];
+        child.newest = child.mtimes.empty() ? 0 : *child.mtimes.rbegin();
+        if (child.parent < 0)
+            continue;
+        DirNode &parent = m_dirs[child.parent];
+        parent.bytes += child.bytes;
+        parent.files += child.files;
+        if (child.newest > 0)
+            parent.mtimes.insert(child.newest);
+    }
+
+    m_bySize.clear();
+    for (int i = 0; i < m_dirs.size(); ++i)
+        m_bySize.insert({m_dirs.at(i).bytes, i});
+}
+
+void MtpDirectoryRollup::adjust(int dir, qint64 bytesDelta, qint64 filesDelta) {
+    for (int d = dir; d >= 0; d = m_dirs.at(d).parent) {
+        DirNode &node = m_dirs[d];
+        m_bySize.erase({node.bytes, d});
+        node.bytes = static_cast<quint64>(static_cast<qint64>(node.bytes) + bytesDelta);
+        node.files = static_cast<quint64>(static_cast<qint64>(node.files) + filesDelta);
+        m_bySize.insert({node.bytes, d});
+    }
+}
+
+// Swaps one of the folder's mtimes (0 for none) and carries a change of its
+// newest up to the parent, which holds that newest among its own mtimes.
+// Stops at the first folder whose newest stays the same.
+void MtpDirectoryRollup::updateNewest(int dir, qint64 removed, qint64 added) {
+    for (int d = dir; d >= 0 && removed != added; d = m_dirs.at(d).parent) {
+        DirNode &node = m_dirs[d];
+        if (removed > 0) {
+            auto it = node.mtimes.find(removed);
+            if (it != node.mtimes.end())
+                node.mtimes.erase(it);
+        }
+        if (added > 0)
+            node.mtimes.insert(added);
+
+        const qint64 newest = node.mtimes.empty() ? 0 : *node.mtimes.rbegin();
+        removed = node.newest;
+        added = newest;
+        node.newest = newest;
+    }
+}
+
+void MtpDirectoryRollup::detachFile(int file) {
+    FileNode &node = m_files[file];
+    QVector<int> &siblings = m_dirs[node.dir].childFiles;
+    const int last = siblings.takeLast();
+    if (last != file) {
+        siblings[node.slot] = last;
+        m_files[last].slot = node.slot;
+    }
+    m_fileIndex.remove(node.path);
+    node.dir = -1;
+    node.slot = -1;
+    ++m_deadFiles;
+}
+
+void MtpDirectoryRollup::addFile(const QString &path, quint64 size, qint64 mtime) {
+    const QString file = normalizedFile(path);
+    auto it = m_fileIndex.constFind(file);
+    if (it != m_fileIndex.constEnd()) {
+        // Overwritten in place; only the differences travel up.
+        FileNode &node = m_files[it.value()];
+        const int dir = node.dir;
+        const quint64 oldSize = node.size;
+        const qint64 oldMtime = node.mtime;
+        node.size = size;
+        node.mtime = mtime;
+        adjust(dir, static_cast<qint64>(size) - static_cast<qint64>(oldSize), 0);
+        updateNewest(dir, oldMtime, mtime);
+        return;
+    }
+
+    const int dir = ensureDir(parentDir(file));
+    appendFile(file, dir, size, mtime);
+    adjust(dir, static_cast<qint64>(size), 1);
+    updateNewest(dir, 0, mtime);
+}
+
+bool MtpDirectoryRollup::removeFile(const QString &path) {
+    auto it = m_fileIndex.constFind(normalizedFile(path));
+    if (it == m_fileIndex.constEnd())
+        return false;
+
+    const int index = it.value();
+    const FileNode node = m_files.at(index);
+    detachFile(index);
+    adjust(node.dir, -static_cast<qint64>(node.size), -1);
+    updateNewest(node.dir, node.mtime, 0);
+    compactIfSparse();
+    return true;
+}
+
+void MtpDirectoryRollup::addDirectory(const QString &path) {
+    ensureDir(normalizedDir(path));
+}
+
+void MtpDirectoryRollup::dropSubtree(int dir) {
+    DirNode &node = m_dirs[dir];
+    for (int child : std::as_const(node.childDirs))
+        dropSubtree(child);
+    for (int file : std::as_const(node.childFiles)) {
+        m_fileIndex.remove(m_files.at(file).path);
+        m_files[file].dir = -1;
+        m_files[file].slot = -1;
+        ++m_deadFiles;
+    }
+    m_bySize.erase({node.bytes, dir});
+    m_dirIndex.remove(node.path);
+    node = DirNode();
+    ++m_deadDirs;
+}
+
+bool MtpDirectoryRollup::removeDirectory(const QString &path) {
+    const QString dirPath = normalizedDir(path);
+    if (dirPath == "/") {
+        clear();
+        return true;
+    }
+
+    auto it = m_dirIndex.constFind(dirPath);
+    if (it == m_dirIndex.constEnd())
+        return false;
+
+    const int index = it.value();
+    const DirNode &node = m_dirs.at(index);
+    const int parent = node.parent;
+    const int slot = node.slot;
+    const qint64 newest = node.newest;
+    adjust(parent, -static_cast<qint64>(node.bytes), -static_cast<qint64>(node.files));
+
+    QVector<int> &siblings = m_dirs[parent].childDirs;
+    const int last = siblings.takeLast();
+    if (last != index) {
+        siblings[slot] = last;
+        m_dirs[last].slot = slot;
+    }
+
+    dropSubtree(index);
+    updateNewest(parent, newest, 0);
+    compactIfSparse();
+    return true;
+}
+
+// Renumbers the live entries in their current order, which keeps parents
+// ahead of their children and every slot where it was.
+void MtpDirectoryRollup::compactIfSparse() {
+    const bool sparseDirs = m_deadDirs > kMinCompactHoles && m_deadDirs > m_dirIndex.size();
+    const bool sparseFiles = m_deadFiles > kMinCompactHoles && m_deadFiles > m_fileIndex.size();
+    if (!sparseDirs && !sparseFiles)
+        return;
+
+    QVector<int> dirMap(m_dirs.size(), -1);
+    QVector<DirNode> dirs;
+    dirs.reserve(m_dirIndex.size());
+    for (int i = 0; i < m_dirs.size(); ++i) {
+        if (m_dirs.at(i).path.isEmpty())
+            continue;
+        dirMap[i] = dirs.size();
+        dirs.append(std::move(m_dirs[i]));
+    }
+
+    QVector<int> fileMap(m_files.size(), -1);
+    QVector<FileNode> files;
+    files.reserve(m_fileIndex.size());
+    for (int i = 0; i < m_files.size(); ++i) {
+        if (m_files.at(i).dir < 0)
+            continue;
+        fileMap[i] = files.size();
+        files.append(std::move(m_files[i]));
+    }
+
+    m_dirIndex.clear();
+    m_bySize.clear();
+    for (int i = 0; i < dirs.size(); ++i) {
+        DirNode &node = dirs[i];
+        if (node.parent >= 0)
+            node.parent = dirMap.at(node.parent);
+        for (int &child : node.childDirs)
+            child = dirMap.at(child);
+        for (int &file : node.childFiles)
+            file = fileMap.at(file);
+        m_dirIndex.insert(node.path, i);
+        m_bySize.insert({node.bytes, i});
+    }
+
+    m_fileIndex.clear();
+    for (int i = 0; i < files.size(); ++i) {
+        files[i].dir = dirMap.at(files.at(i).dir);
+        m_fileIndex.insert(files.at(i).path, i);
+    }
+
+    m_dirs = std::move(dirs);
+    m_files = std::move(files);
+    m_deadDirs = 0;
+    m_deadFiles = 0;
+}
+
+bool MtpDirectoryRollup::contains(const QString &directoryPath) const {
+    return m_dirIndex.contains(normalizedDir(directoryPath));
+}
+
+MtpDirectoryStats MtpDirectoryRollup::stats(const QString &directoryPath) const {
+    MtpDirectoryStats result;
+    auto it = m_dirIndex.constFind(normalizedDir(directoryPath));
+    if (it != m_dirIndex.constEnd()) {
+        const DirNode &node = m_dirs.at(it.value());
+        result.totalBytes = node.bytes;
+        result.fileCount = node.files;
+        result.newestMtime = node.newest;
+    }
+    return result;
+}
+
+bool MtpDirectoryRollup::fileStats(const QString &path, quint64 &size, qint64 &mtime) const {
+    auto it = m_fileIndex.constFind(normalizedFile(path));
+    if (it == m_fileIndex.constEnd())
+        return false;
+    size = m_files.at(it.value()).size;
+    mtime = m_files.at(it.value()).mtime;
+    return true;
+}
+
+QVector<MtpFolderUsage> MtpDirectoryRollup::largestFolders(int count) const {
+    QVector<MtpFolderUsage> result;
+    for (auto it = m_bySize.crbegin(); it != m_bySize.crend() && result.size() < count; ++it) {
+        const int index = it->second;
+        if (index == 0) // the root is always the largest
+            continue;
+        const DirNode &node = m_dirs.at(index);
+        MtpFolderUsage usage;
+        usage.path = node.path;
+        usage.stats.totalBytes = node.bytes;
+        usage.stats.fileCount = node.files;
+        usage.stats.newestMtime = node.newest;
+        result.append(usage);
+    }
+    return result;
+}
+
+QStringList MtpDirectoryRollup::paths() const {
+    QStringList result;
+    result.reserve(m_dirIndex.size() + m_fileIndex.size());
+    for (auto it = m_dirIndex.cbegin(); it != m_dirIndex.cend(); ++it) {
+        if (it.key() != "/")
+            result << it.key();
+    }
+    for (auto it = m_fileIndex.cbegin(); it != m_fileIndex.cend(); ++it)
+        result << it.key();
+    return result;
+}
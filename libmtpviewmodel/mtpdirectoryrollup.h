@@ -0,0 +1,98 @@
+#ifndef MTPDIRECTORYROLLUP_H
+#define MTPDIRECTORYROLLUP_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <set>
+#include <utility>
+#include "imtdevice.h"
+
+struct MtpDirectoryStats {
+    quint64 totalBytes = 0;
+    quint64 fileCount = 0;
+    qint64 newestMtime = 0; // seconds since epoch, 0 when the folder has no files
+};
+
+struct MtpFolderUsage {
+    QString path;
+    MtpDirectoryStats stats;
+};
+
+// Per-folder totals of bytes, files and newest mtime, including everything
+// below the folder. build() computes them bottom-up in one pass over a
+// listing; addFile()/removeFile() then adjust only the ancestors of the
+// changed path, independent of how many siblings they have: children are
+// unlinked by swapping with the last one, and each folder keeps the mtimes
+// of its files and subfolders ordered so losing the newest is a lookup, not
+// a rescan. Folders are also kept ordered by size so largestFolders()
+// doesn't have to scan the tree. Removed entries leave holes that are
+// compacted away once they outnumber the live ones.
+//
+// Folder paths are normalized to "/a/b/", file paths to "/a/b/c".
+class MtpDirectoryRollup {
+public:
+    MtpDirectoryRollup();
+
+    void build(const QVector<MtpFileInfo> &entries);
+    void clear();
+
+    void addFile(const QString &path, quint64 size, qint64 mtime);
+    bool removeFile(const QString &path);
+    void addDirectory(const QString &path);
+    bool removeDirectory(const QString &path);
+
+    bool contains(const QString &directoryPath) const;
+    MtpDirectoryStats stats(const QString &directoryPath) const;
+    bool fileStats(const QString &path, quint64 &size, qint64 &mtime) const;
+    QVector<MtpFolderUsage> largestFolders(int count) const;
+    // Every folder below the root and every file, in no particular order.
+    QStringList paths() const;
+
+    int directoryCount() const { return m_dirIndex.size(); }
+    int fileCount() const { return m_fileIndex.size(); }
+
+private:
+    struct DirNode {
+        QString path;            // empty once removed
+        int parent = -1;
+        int slot = -1;           // position in the parent's childDirs
+        quint64 bytes = 0;
+        quint64 files = 0;
+        qint64 newest = 0;
+        QVector<int> childDirs;
+        QVector<int> childFiles;
+        std::multiset<qint64> mtimes; // own files' mtimes and subfolders' newest, zeros left out
+    };
+
+    struct FileNode {
+        QString path;
+        int dir = -1;            // -1 once removed
+        int slot = -1;           // position in the folder's childFiles
+        quint64 size = 0;
+        qint64 mtime = 0;
+    };
+
+    static QString normalizedDir(const QString &path);
+    static QString normalizedFile(const QString &path);
+    static QString parentDir(const QString &path);
+
+    int ensureDir(const QString &dirPath);
+    int appendFile(const QString &path, int dir, quint64 size, qint64 mtime);
+    void adjust(int dir, qint64 bytesDelta, qint64 filesDelta);
+    void updateNewest(int dir, qint64 removed, qint64 added);
+    void detachFile(int file);
+    void dropSubtree(int dir);
+    void compactIfSparse();
+
+    QVector<DirNode> m_dirs;   // a parent always has a lower index than its children
+    QVector<FileNode> m_files;
+    QHash<QString, int> m_dirIndex;
+    QHash<QString, int> m_fileIndex;
+    std::set<std::pair<quint64, int>> m_bySize;
+    int m_deadDirs;
+    int m_deadFiles;
+};
+
+#endif // MTPDIRECTORYROLLUP_H
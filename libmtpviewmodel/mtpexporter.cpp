@@ -0,0 +1,258 @@
+#include "mtpexporter.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <QLoggingCategory>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(lcMtpExporter, "mtp.exporter", QtWarningMsg)
+
+namespace {
+
+struct TransferBuffer {
+    QString devicePath;
+    QString localPath;
+    quint64 offset = 0;
+    QByteArray data;
+    QByteArray digest;
+    bool ok = false;
+    bool last = true;
+};
+
+// Fixed-capacity hand-off between two pipeline stages. push() blocks while the
+// consumer is behind, which is what bounds the memory held by the pipeline.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(int capacity) : m_capacity(qMax(1, capacity)), m_closed(false) {}
+
+    bool push(T item) {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.size() >= m_capacity && !m_closed)
+            m_notFull.wait(&m_mutex);
+        if (m_closed)
+            return false;
+        m_items.enqueue(std::move(item));
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    bool pop(T &item) {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.isEmpty() && !m_closed)
+            m_notEmpty.wait(&m_mutex);
+        if (m_items.isEmpty())
+            return false;
+        item = m_items.dequeue();
+        m_notFull.wakeOne();
+        return true;
+    }
+
+    void close() {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<T> m_items;
+    int m_capacity;
+    bool m_closed;
+};
+
+QString parentOf(const QString &path) {
+    int slash = path.lastIndexOf('/', path.endsWith('/') ? path.size() - 2 : -1);
+    return slash < 0 ? QString() : path.left(slash + 1);
+}
+
+} // namespace
+
+MtpExporter::MtpExporter(IMtpDevice *device, const MtpExportOptions &options)
+    : m_device(device), m_options(options), m_cancelled(false)
+{
+}
+
+QString MtpExporter::relativePath(const QString &devicePath, const QString &entry) {
+    QString base = devicePath;
+    if (base.startsWith('/')) base = base.mid(1);
+    if (!base.isEmpty() && !base.endsWith('/')) base += '/';
+
+    QString rel = entry;
+    if (rel.startsWith('/')) rel = rel.mid(1);
+    if (rel.startsWith(base)) rel = rel.mid(base.size());
+    return rel;
+}
+
+QString MtpExporter::localPathFor(const QString &devicePath, const QString &entry, const QString &localDir) {
+    const QString root = QDir::cleanPath(localDir);
+    const QString prefix = root.endsWith('/') ? root : root + '/';
+    const QString path = QDir::cleanPath(prefix + relativePath(devicePath, entry));
+    return path == root || path.startsWith(prefix) ? path : QString();
+}
+
+// Objects of at most smallObjectSize go first, where per-object round trips
+// dominate, grouped by folder so the device resolves each parent handle once.
+// Larger objects follow, smallest first.
+QVector<MtpFileInfo> MtpExporter::orderForTransfer(const QVector<MtpFileInfo> &files, quint64 smallObjectSize) {
+    QVector<MtpFileInfo> ordered = files;
+    std::stable_sort(ordered.begin(), ordered.end(), [smallObjectSize](const MtpFileInfo &a, const MtpFileInfo &b) {
+        const bool smallA = a.size <= smallObjectSize;
+        const bool smallB = b.size <= smallObjectSize;
+        if (smallA != smallB)
+            return smallA;
+        if (!smallA && a.size != b.size)
+            return a.size < b.size;
+        const QString pa = parentOf(a.path);
+        const QString pb = parentOf(b.path);
+        return pa != pb ? pa < pb : a.path < b.path;
+    });
+    return ordered;
+}
+
+MtpExportResult MtpExporter::exportTree(const QString &devicePath, const QString &localDir,
+                                        const ProgressCallback &progress) {
+    MtpExportResult result;
+    m_cancelled = false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Objects are resolved once here; the reader then addresses them by id.
+    // Names come from the device, so any that would land outside localDir
+    // are refused rather than written.
+    QVector<MtpFileInfo> files;
+    QHash<QString, QString> localPaths;
+    const QVector<MtpFileInfo> entries = m_device->getFileInfoList(devicePath);
+    for (const MtpFileInfo &entry : entries) {
+        const QString localPath = localPathFor(devicePath, entry.path, localDir);
+        if (localPath.isEmpty()) {
+            qCWarning(lcMtpExporter) << "refusing" << entry.path << "outside of" << localDir;
+            if (!entry.isDir) {
+                ++result.filesFailed;
+                result.failedPaths << entry.path;
+            }
+        } else if (entry.isDir) {
+            QDir().mkpath(localPath);
+        } else {
+            files << entry;
+            localPaths.insert(entry.path, localPath);
+        }
+    }
+    files = orderForTransfer(files, m_options.chunkSize);
+    qCDebug(lcMtpExporter) << "exporting" << files.size() << "files from" << devicePath << "to" << localDir;
+
+    BoundedQueue<TransferBuffer> readQueue(m_options.bufferDepth);
+    BoundedQueue<TransferBuffer> hashQueue(m_options.bufferDepth);
+    BoundedQueue<TransferBuffer> &writeQueue = m_options.computeHashes ? hashQueue : readQueue;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+
+    QFuture<void> reader = QtConcurrent::run(&pool, [&]() {
+        for (const MtpFileInfo &object : std::as_const(files)) {
+            if (m_cancelled)
+                break;
+            const QString &path = object.path;
+            const QString localPath = localPaths.value(path);
+            quint64 offset = 0;
+            bool last = false;
+            while (!last) {
+                TransferBuffer buffer;
+                buffer.devicePath = path;
+                buffer.localPath = localPath;
+                buffer.offset = offset;
+                buffer.ok = m_device->readObjectRange(object, offset, m_options.chunkSize, buffer.data);
+                const bool complete = static_cast<quint64>(buffer.data.size()) < m_options.chunkSize;
+                if (buffer.ok && !complete && m_cancelled)
+                    buffer.ok = false;
+                buffer.last = last = !buffer.ok || complete;
+                offset += buffer.data.size();
+                if (!readQueue.push(std::move(buffer)))
+                    return;
+            }
+        }
+        readQueue.close();
+    });
+
+    QFuture<void> hasher;
+    if (m_options.computeHashes) {
+        hasher = QtConcurrent::run(&pool, [&]() {
+            QCryptographicHash hash(m_options.hashAlgorithm);
+            TransferBuffer buffer;
+            while (readQueue.pop(buffer)) {
+                if (buffer.offset == 0)
+                    hash.reset();
+                if (buffer.ok) {
+                    hash.addData(buffer.data);
+                    if (buffer.last)
+                        buffer.digest = hash.result();
+                }
+                if (!hashQueue.push(std::move(buffer)))
+                    break;
+                buffer = TransferBuffer();
+            }
+            hashQueue.close();
+        });
+    }
+
+    TransferBuffer buffer;
+    QFile file;
+    bool opened = false;
+    bool written = false;
+    int filesDone = 0;
+    while (writeQueue.pop(buffer)) {
+        if (buffer.offset == 0) {
+            file.close();
+            file.setFileName(buffer.localPath);
+            QDir().mkpath(QFileInfo(buffer.localPath).absolutePath());
+            opened = buffer.ok && file.open(QIODevice::WriteOnly);
+            written = opened;
+        }
+        written = written && buffer.ok && file.write(buffer.data) == buffer.data.size();
+        if (written)
+            result.bytesCopied += buffer.data.size();
+
+        if (!buffer.last) {
+            buffer = TransferBuffer();
+            continue;
+        }
+
+        file.close();
+        if (written) {
+            ++result.filesCopied;
+            if (!buffer.digest.isEmpty())
+                result.hashes.insert(buffer.devicePath, buffer.digest);
+        } else {
+            qCWarning(lcMtpExporter) << "failed to export" << buffer.devicePath;
+            if (opened)
+                file.remove();
+            ++result.filesFailed;
+            result.failedPaths << buffer.devicePath;
+        }
+
+        ++filesDone;
+        if (progress)
+            progress(filesDone, files.size(), result.bytesCopied);
+        buffer = TransferBuffer();
+    }
+
+    reader.waitForFinished();
+    if (m_options.computeHashes)
+        hasher.waitForFinished();
+
+    result.elapsedMs = timer.elapsed();
+    qCDebug(lcMtpExporter) << "exported" << result.filesCopied << "files," << result.bytesCopied
+                           << "bytes in" << result.elapsedMs << "ms (" << result.throughputMBps() << "MB/s)";
+    return result;
+}
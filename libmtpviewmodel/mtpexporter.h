@@ -0,0 +1,60 @@
+#ifndef MTPEXPORTER_H
+#define MTPEXPORTER_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QCryptographicHash>
+#include <atomic>
+#include <functional>
+#include "imtdevice.h"
+
+struct MtpExportOptions {
+    bool computeHashes = false;
+    QCryptographicHash::Algorithm hashAlgorithm = QCryptographicHash::Sha256;
+    int bufferDepth = 2; // buffers in flight between two stages, 2 = double buffering
+    quint64 chunkSize = 4 * 1024 * 1024; // large objects are streamed in ranged reads of this size
+};
+
+struct MtpExportResult {
+    int filesCopied = 0;
+    int filesFailed = 0;
+    quint64 bytesCopied = 0;
+    qint64 elapsedMs = 0;
+    QStringList failedPaths;
+    QHash<QString, QByteArray> hashes; // device path -> digest, only with computeHashes
+
+    double throughputMBps() const {
+        return elapsedMs > 0 ? (bytesCopied / (1024.0 * 1024.0)) / (elapsedMs / 1000.0) : 0.0;
+    }
+};
+
+// Copies a device subtree into a local directory. USB reads, hashing and disk
+// writes run as separate stages connected by bounded queues, so the link keeps
+// reading the next object while the previous one is hashed and written out.
+class MtpExporter {
+public:
+    using ProgressCallback = std::function<void(int filesDone, int filesTotal, quint64 bytesDone)>;
+
+    explicit MtpExporter(IMtpDevice *device, const MtpExportOptions &options = MtpExportOptions());
+
+    MtpExportResult exportTree(const QString &devicePath, const QString &localDir,
+                               const ProgressCallback &progress = ProgressCallback());
+    void cancel() { m_cancelled = true; }
+
+    static QVector<MtpFileInfo> orderForTransfer(const QVector<MtpFileInfo> &files, quint64 smallObjectSize);
+    // entry's path below devicePath, without a leading slash.
+    static QString relativePath(const QString &devicePath, const QString &entry);
+    // Where entry lands below localDir, or an empty string when its name
+    // would resolve outside of it, e.g. through ".." components.
+    static QString localPathFor(const QString &devicePath, const QString &entry, const QString &localDir);
+
+private:
+    IMtpDevice *m_device;
+    MtpExportOptions m_options;
+    std::atomic<bool> m_cancelled;
+};
+
+#endif // MTPEXPORTER_H
@@ -0,0 +1,308 @@
+#include "mtphotplugmonitor.h"
+#include "mtpdevice.h"
+#include "mtptrace.h"
+#include <QDir>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QSocketNotifier>
+#include <QtConcurrent>
+#ifdef MTP_HAVE_LIBUDEV
+#include <libudev.h>
+#include <cstdlib>
+#endif
+
+Q_LOGGING_CATEGORY(lcMtpHotplug, "mtp.hotplug", QtWarningMsg)
+
+namespace {
+
+int readNumber(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+    bool ok = false;
+    const int value = file.readAll().trimmed().toInt(&ok);
+    return ok ? value : -1;
+}
+
+} // namespace
+
+MtpHotplugMonitor::MtpHotplugMonitor(Source source, QObject *parent)
+    : QObject(parent)
+    , m_source(source)
+    , m_active(source)
+    , m_running(false)
+    , m_udev(nullptr)
+    , m_udevMonitor(nullptr)
+    , m_udevNotifier(nullptr)
+{
+    qRegisterMetaType<MtpHotplugDevice>();
+
+    m_pollTimer.setInterval(1000);
+    connect(&m_pollTimer, &QTimer::timeout, this, &MtpHotplugMonitor::pollSysfs);
+
+    // Bursts of add events (hubs, composite devices) are opened together.
+    m_settleTimer.setInterval(250);
+    m_settleTimer.setSingleShot(true);
+    connect(&m_settleTimer, &QTimer::timeout, this, &MtpHotplugMonitor::openPending);
+
+    connect(&m_openWatcher, &QFutureWatcher<QVector<Session>>::finished, this, &MtpHotplugMonitor::onOpenFinished);
+}
+
+MtpHotplugMonitor::~MtpHotplugMonitor() {
+    stop();
+    // m_opening is only cleared once onOpenFinished() took the batch, so a
+    // batch that finished but wasn't delivered yet is released here too.
+    if (!m_opening.isEmpty()) {
+        m_openWatcher.waitForFinished();
+        for (const Session &session : m_openWatcher.result())
+            MtpDevice::releaseDevice(session.handle);
+    }
+}
+
+bool MtpHotplugMonitor::start() {
+    if (m_running)
+        return true;
+
+    m_active = m_source;
+    if (m_active == Simulated) {
+        m_running = true;
+        return true;
+    }
+
+    if (m_active == Udev || m_active == Auto) {
+        if (startUdev()) {
+            m_active = Udev;
+        } else if (m_active == Udev) {
+            qWarning() << "MtpHotplugMonitor: udev monitoring is not available";
+            return false;
+        } else {
+            m_active = SysfsPoll;
+        }
+    }
+
+    m_running = true;
+    qCDebug(lcMtpHotplug) << "Watching for USB devices using" << (m_active == Udev ? "udev" : "sysfs polling");
+
+    // Whatever is plugged in already is treated as just added. The udev
+    // monitor is live before this scan, so nothing can slip in between.
+    m_present = scanSysfs();
+    for (quint32 location : std::as_const(m_present))
+        m_pending.insert(location);
+    if (!m_pending.isEmpty())
+        openPending();
+
+    if (m_active == SysfsPoll)
+        m_pollTimer.start();
+    return true;
+}
+
+void MtpHotplugMonitor::stop() {
+    if (!m_running)
+        return;
+    m_running = false;
+    m_pollTimer.stop();
+    m_settleTimer.stop();
+    stopUdev();
+
+    // Sessions are released without deviceRemoved; the devices are still
+    // attached, we just stopped looking.
+    MtpDevice::closeSessions(this);
+    m_sessions.clear();
+    m_present.clear();
+    m_pending.clear();
+    m_removedWhileOpening += m_opening;
+}
+
+QVector<MtpHotplugDevice> MtpHotplugMonitor::devices() const {
+    QVector<MtpHotplugDevice> result;
+    result.reserve(m_sessions.size());
+    for (const Session &session : m_sessions)
+        result.append(session.device);
+    return result;
+}
+
+void MtpHotplugMonitor::simulateDeviceAdded(int busNumber, int deviceNumber, const MtpDeviceInfo &info) {
+    const quint32 location = key(busNumber, deviceNumber);
+    if (!m_running || m_sessions.contains(location))
+        return;
+    Session session;
+    session.device.busNumber = busNumber;
+    session.device.deviceNumber = deviceNumber;
+    session.device.info = info;
+    m_present.insert(location);
+    m_sessions.insert(location, session);
+    emit deviceAdded(session.device);
+}
+
+void MtpHotplugMonitor::simulateDeviceRemoved(int busNumber, int deviceNumber) {
+    if (m_running)
+        usbRemoved(key(busNumber, deviceNumber));
+}
+
+QSet<quint32> MtpHotplugMonitor::scanSysfs() {
+    QSet<quint32> found;
+    const QDir dir("/sys/bus/usb/devices");
+    const QStringList entries = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &entry : entries) {
+        if (entry.contains(':')) // interfaces, not devices
+            continue;
+        const int bus = readNumber(dir.filePath(entry + "/busnum"));
+        const int dev = readNumber(dir.filePath(entry + "/devnum"));
+        if (bus >= 0 && dev >= 0)
+            found.insert(key(bus, dev));
+    }
+    return found;
+}
+
+void MtpHotplugMonitor::pollSysfs() {
+    MTP_TRACE_SPAN("hotplug.pollSysfs", "hotplug");
+    const QSet<quint32> now = scanSysfs();
+    const QSet<quint32> before = m_present;
+    for (quint32 location : before) {
+        if (!now.contains(location))
+            usbRemoved(location);
+    }
+    for (quint32 location : now) {
+        if (!before.contains(location))
+            usbAdded(location);
+    }
+}
+
+bool MtpHotplugMonitor::startUdev() {
+#ifdef MTP_HAVE_LIBUDEV
+    udev *context = udev_new();
+    if (!context)
+        return false;
+    udev_monitor *monitor = udev_monitor_new_from_netlink(context, "udev");
+    if (!monitor
+        || udev_monitor_filter_add_match_subsystem_devtype(monitor, "usb", "usb_device") < 0
+        || udev_monitor_enable_receiving(monitor) < 0) {
+        if (monitor)
+            udev_monitor_unref(monitor);
+        udev_unref(context);
+        return false;
+    }
+
+    m_udev = context;
+    m_udevMonitor = monitor;
+    m_udevNotifier = new QSocketNotifier(udev_monitor_get_fd(monitor), QSocketNotifier::Read, this);
+    connect(m_udevNotifier, &QSocketNotifier::activated, this, &MtpHotplugMonitor::readUdevEvents);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MtpHotplugMonitor::stopUdev() {
+    delete m_udevNotifier;
+    m_udevNotifier = nullptr;
+#ifdef MTP_HAVE_LIBUDEV
+    if (m_udevMonitor)
+        udev_monitor_unref(static_cast<udev_monitor *>(m_udevMonitor));
+    if (m_udev)
+        udev_unref(static_cast<udev *>(m_udev));
+#endif
+    m_udevMonitor = nullptr;
+    m_udev = nullptr;
+}
+
+void MtpHotplugMonitor::readUdevEvents() {
+#ifdef MTP_HAVE_LIBUDEV
+    udev_monitor *monitor = static_cast<udev_monitor *>(m_udevMonitor);
+    while (udev_device *device = udev_monitor_receive_device(monitor)) {
+        const char *action = udev_device_get_action(device);
+        const char *busnum = udev_device_get_property_value(device, "BUSNUM");
+        const char *devnum = udev_device_get_property_value(device, "DEVNUM");
+        if (action && busnum && devnum) {
+            const quint32 location = key(atoi(busnum), atoi(devnum));
+            if (qstrcmp(action, "add") == 0)
+                usbAdded(location);
+            else if (qstrcmp(action, "remove") == 0)
+                usbRemoved(location);
+        }
+        udev_device_unref(device);
+    }
+#endif
+}
+
+void MtpHotplugMonitor::usbAdded(quint32 location) {
+    m_present.insert(location);
+    if (m_sessions.contains(location) || m_opening.contains(location))
+        return;
+    qCDebug(lcMtpHotplug) << "USB device added at bus" << (location >> 16) << "device" << (location & 0xffff);
+    m_pending.insert(location);
+    m_settleTimer.start();
+}
+
+void MtpHotplugMonitor::usbRemoved(quint32 location) {
+    m_present.remove(location);
+    m_pending.remove(location);
+    if (m_opening.contains(location))
+        m_removedWhileOpening.insert(location);
+
+    auto it = m_sessions.find(location);
+    if (it == m_sessions.end())
+        return;
+    const Session session = it.value();
+    m_sessions.erase(it);
+    // Whoever opened it, the device is gone.
+    if (m_active != Simulated)
+        MtpDevice::unregisterSession(session.device.busNumber, session.device.deviceNumber);
+    qCDebug(lcMtpHotplug) << "MTP device removed:" << session.device.info.friendlyName;
+    emit deviceRemoved(session.device);
+}
+
+void MtpHotplugMonitor::openPending() {
+    // One open batch at a time; whatever arrives meanwhile goes next.
+    if (m_pending.isEmpty() || m_openWatcher.isRunning())
+        return;
+
+    QVector<QPair<int, int>> locations;
+    for (quint32 location : std::as_const(m_pending))
+        locations.append({int(location >> 16), int(location & 0xffff)});
+    m_opening = m_pending;
+    m_pending.clear();
+
+    m_openWatcher.setFuture(QtConcurrent::run([locations]() {
+        MTP_TRACE_SPAN("hotplug.open", "hotplug");
+        QVector<Session> sessions;
+        for (const MtpDevice::OpenedDevice &opened : MtpDevice::openDevicesAt(locations)) {
+            Session session;
+            session.device.busNumber = opened.busNumber;
+            session.device.deviceNumber = opened.deviceNumber;
+            session.device.info = opened.info;
+            session.handle = opened.device;
+            sessions.append(session);
+        }
+        return sessions;
+    }));
+}
+
+void MtpHotplugMonitor::onOpenFinished() {
+    const QVector<Session> sessions = m_openWatcher.result();
+    const QSet<quint32> removed = m_removedWhileOpening;
+    m_opening.clear();
+    m_removedWhileOpening.clear();
+
+    for (const Session &session : sessions) {
+        const quint32 location = key(session.device.busNumber, session.device.deviceNumber);
+        if (!m_running || removed.contains(location) || m_sessions.contains(location)) {
+            MtpDevice::releaseDevice(session.handle);
+            continue;
+        }
+        if (session.handle) {
+            MtpDevice::OpenedDevice opened;
+            opened.busNumber = session.device.busNumber;
+            opened.deviceNumber = session.device.deviceNumber;
+            opened.device = session.handle;
+            opened.info = session.device.info;
+            MtpDevice::registerSession(opened, this);
+        }
+        m_sessions.insert(location, session);
+        qCDebug(lcMtpHotplug) << "MTP device added:" << session.device.info.friendlyName;
+        emit deviceAdded(session.device);
+    }
+
+    if (m_running && !m_pending.isEmpty())
+        openPending();
+}
@@ -0,0 +1,112 @@
+#ifndef MTPHOTPLUGMONITOR_H
+#define MTPHOTPLUGMONITOR_H
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QMetaType>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+#include "imtdevice.h"
+
+struct LIBMTP_mtpdevice_struct;
+class QSocketNotifier;
+
+struct MtpHotplugDevice {
+    int busNumber = 0;
+    int deviceNumber = 0;
+    MtpDeviceInfo info;
+};
+Q_DECLARE_METATYPE(MtpHotplugDevice)
+
+// Watches for USB devices coming and going and keeps one open libmtp
+// session per attached MTP device. Add/remove notifications come from udev
+// over netlink when the library was built with libudev, otherwise from a
+// cheap scan of /sys/bus/usb/devices; neither touches libmtp. Only a USB
+// location that wasn't seen before is probed and opened (off the calling
+// thread), and a removed device's session is released as soon as the
+// removal is seen.
+//
+// Sessions are registered with MtpDevice, so MtpDevice and MtpDeviceAdapter
+// calls run on them instead of opening the device per call. A device that
+// already had a session (an adapter opened it first) is reported but left to
+// its owner until it is unplugged.
+//
+// The Simulated source never talks to USB; tests and the stub backend drive
+// it with simulateDeviceAdded()/simulateDeviceRemoved().
+class MtpHotplugMonitor : public QObject {
+    Q_OBJECT
+
+public:
+    enum Source {
+        Auto,       // udev when available, sysfs polling otherwise
+        Udev,
+        SysfsPoll,
+        Simulated
+    };
+
+    explicit MtpHotplugMonitor(Source source = Auto, QObject *parent = nullptr);
+    ~MtpHotplugMonitor();
+
+    // Starts watching and reports the devices already attached as added.
+    bool start();
+    void stop();
+    bool isRunning() const { return m_running; }
+    Source activeSource() const { return m_active; }
+
+    // Interval of the sysfs fallback; 1000 ms by default.
+    void setPollInterval(int ms) { m_pollTimer.setInterval(ms); }
+    // Time given to a new device to enumerate its MTP interface before it
+    // is opened; 250 ms by default.
+    void setSettleDelay(int ms) { m_settleTimer.setInterval(ms); }
+
+    QVector<MtpHotplugDevice> devices() const;
+
+    void simulateDeviceAdded(int busNumber, int deviceNumber, const MtpDeviceInfo &info);
+    void simulateDeviceRemoved(int busNumber, int deviceNumber);
+
+signals:
+    void deviceAdded(const MtpHotplugDevice &device);
+    void deviceRemoved(const MtpHotplugDevice &device);
+
+private slots:
+    void pollSysfs();
+    void readUdevEvents();
+    void openPending();
+    void onOpenFinished();
+
+private:
+    struct Session {
+        MtpHotplugDevice device;
+        LIBMTP_mtpdevice_struct *handle = nullptr; // nullptr when the session isn't ours
+    };
+
+    static quint32 key(int busNumber, int deviceNumber) { return quint32(busNumber) << 16 | quint32(deviceNumber & 0xffff); }
+    static QSet<quint32> scanSysfs();
+
+    bool startUdev();
+    void stopUdev();
+    void usbAdded(quint32 location);
+    void usbRemoved(quint32 location);
+
+    Source m_source;
+    Source m_active;
+    bool m_running;
+
+    QHash<quint32, Session> m_sessions;
+    QSet<quint32> m_present;   // every USB device seen, MTP or not
+    QSet<quint32> m_pending;   // added, waiting to be opened
+    QSet<quint32> m_opening;   // handed to the open worker
+    QSet<quint32> m_removedWhileOpening;
+
+    QTimer m_pollTimer;
+    QTimer m_settleTimer;
+    QFutureWatcher<QVector<Session>> m_openWatcher;
+
+    void *m_udev;
+    void *m_udevMonitor;
+    QSocketNotifier *m_udevNotifier;
+};
+
+#endif // MTPHOTPLUGMONITOR_H
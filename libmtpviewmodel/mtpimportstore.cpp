@@ -0,0 +1,226 @@
+#include "mtpimportstore.h"
+#include "mtpexporter.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QTemporaryFile>
+#include <QLoggingCategory>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(lcMtpImport, "mtp.import", QtWarningMsg)
+
+namespace {
+
+const quint64 kEdgeBytes = 64 * 1024;
+const quint64 kChunkSize = 4 * 1024 * 1024;
+const int kSaveInterval = 64;
+
+QJsonObject toJson(const QHash<QString, QString> &map) {
+    QJsonObject obj;
+    for (auto it = map.cbegin(); it != map.cend(); ++it)
+        obj[it.key()] = it.value();
+    return obj;
+}
+
+QHash<QString, QString> fromJson(const QJsonObject &obj) {
+    QHash<QString, QString> map;
+    for (auto it = obj.constBegin(); it != obj.constEnd(); ++it)
+        map.insert(it.key(), it.value().toString());
+    return map;
+}
+
+} // namespace
+
+MtpImportStore::MtpImportStore(const QString &rootPath)
+    : m_rootPath(rootPath)
+    , m_valid(false)
+    , m_unsaved(0)
+{
+    if (!QDir().mkpath(m_rootPath + "/objects") || !QDir().mkpath(m_rootPath + "/tmp")) {
+        qCWarning(lcMtpImport) << "cannot create store at" << m_rootPath;
+        return;
+    }
+
+    QFile index(m_rootPath + "/index.json");
+    if (index.open(QIODevice::ReadOnly)) {
+        const QJsonObject root = QJsonDocument::fromJson(index.readAll()).object();
+        m_fingerprints = fromJson(root.value("fingerprints").toObject());
+        m_sources = fromJson(root.value("sources").toObject());
+    }
+    m_valid = true;
+}
+
+MtpImportStore::~MtpImportStore() {
+    if (m_valid && m_unsaved > 0)
+        save();
+}
+
+bool MtpImportStore::save() {
+    QJsonObject root;
+    root["version"] = 1;
+    root["fingerprints"] = toJson(m_fingerprints);
+    root["sources"] = toJson(m_sources);
+
+    QSaveFile index(m_rootPath + "/index.json");
+    if (!index.open(QIODevice::WriteOnly))
+        return false;
+    index.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!index.commit())
+        return false;
+    m_unsaved = 0;
+    return true;
+}
+
+QString MtpImportStore::objectPath(const QString &contentHash) const {
+    return m_rootPath + "/objects/" + contentHash.left(2) + '/' + contentHash;
+}
+
+bool MtpImportStore::hasObject(const QString &contentHash) const {
+    return !contentHash.isEmpty() && QFileInfo::exists(objectPath(contentHash));
+}
+
+QByteArray MtpImportStore::fingerprint(IMtpDevice *device, const MtpFileInfo &info) {
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    QByteArray head;
+    if (!device->readObjectRange(info, 0, kEdgeBytes, head))
+        return QByteArray();
+    hash.addData(head);
+
+    // The tail never overlaps the head, so objects up to twice the edge
+    // size are hashed whole.
+    if (info.size > kEdgeBytes) {
+        const quint64 tailBytes = qMin(kEdgeBytes, info.size - kEdgeBytes);
+        QByteArray tail;
+        if (!device->readObjectRange(info, info.size - tailBytes, tailBytes, tail))
+            return QByteArray();
+        hash.addData(tail);
+    }
+    return hash.result().toHex();
+}
+
+bool MtpImportStore::pullIntoStore(IMtpDevice *device, const MtpFileInfo &info, QString &contentHash) {
+    QTemporaryFile temp(m_rootPath + "/tmp/import-XXXXXX");
+    if (!temp.open())
+        return false;
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    quint64 offset = 0;
+    for (;;) {
+        QByteArray chunk;
+        if (!device->readObjectRange(info, offset, kChunkSize, chunk) || temp.write(chunk) != chunk.size())
+            return false;
+        hash.addData(chunk);
+        offset += chunk.size();
+        if (static_cast<quint64>(chunk.size()) < kChunkSize)
+            break;
+    }
+    if (offset != info.size) {
+        qCWarning(lcMtpImport) << info.path << "changed during transfer";
+        return false;
+    }
+
+    contentHash = QString::fromLatin1(hash.result().toHex());
+    if (hasObject(contentHash))
+        return true;
+
+    // setFileTime needs an open file, so the mtime is set before closing;
+    // the rename keeps it.
+    const QString target = objectPath(contentHash);
+    QDir().mkpath(QFileInfo(target).absolutePath());
+    temp.flush();
+    temp.setFileTime(info.modified, QFileDevice::FileModificationTime);
+    temp.close();
+    if (!temp.rename(target))
+        return false;
+    temp.setAutoRemove(false);
+    return true;
+}
+
+bool MtpImportStore::linkInto(const QString &contentHash, const QString &destPath) {
+    QDir().mkpath(QFileInfo(destPath).absolutePath());
+    QFile::remove(destPath);
+    const QString source = objectPath(contentHash);
+    if (::link(QFile::encodeName(source).constData(), QFile::encodeName(destPath).constData()) == 0)
+        return true;
+    // Hardlinks can't cross filesystems; fall back to a plain copy.
+    return QFile::copy(source, destPath);
+}
+
+MtpImportResult MtpImportStore::import(IMtpDevice *device, const QString &devicePath, const QString &destDir,
+                                       const QString &sourceKey, const ProgressCallback &progress) {
+    MtpImportResult result;
+    if (!m_valid)
+        return result;
+
+    const QString source = sourceKey.isEmpty() ? device->getDeviceInfo() : sourceKey;
+
+    // The listing carries size, mtime and object ID, so nothing is stat'ed.
+    QVector<MtpFileInfo> files;
+    const QVector<MtpFileInfo> entries = device->getFileInfoList(devicePath);
+    for (const MtpFileInfo &entry : entries) {
+        if (!entry.isDir)
+            files << entry;
+    }
+
+    int done = 0;
+    for (const MtpFileInfo &info : std::as_const(files)) {
+        const QString &path = info.path;
+        // Device names that would resolve outside destDir fail the object.
+        const QString destPath = MtpExporter::localPathFor(devicePath, path, destDir);
+        bool ok = !destPath.isEmpty();
+        QString contentHash;
+
+        const qint64 mtime = info.modified.toSecsSinceEpoch();
+        // Object IDs are reassigned when the device reconnects, so the memo
+        // goes by path instead.
+        const QString memoKey = QString("%1|%2|%3|%4").arg(source, path).arg(info.size).arg(mtime);
+        contentHash = m_sources.value(memoKey);
+
+        QString fingerprintKey;
+        if (ok && !hasObject(contentHash)) {
+            const QByteArray partial = fingerprint(device, info);
+            ok = !partial.isEmpty();
+            fingerprintKey = QString("%1:%2:%3").arg(info.size).arg(mtime).arg(QString::fromLatin1(partial));
+            contentHash = m_fingerprints.value(fingerprintKey);
+        }
+
+        if (ok && hasObject(contentHash)) {
+            ++result.deduplicated;
+            result.bytesSaved += info.size;
+        } else if (ok && pullIntoStore(device, info, contentHash)) {
+            ++result.imported;
+            result.bytesTransferred += info.size;
+        } else {
+            ok = false;
+        }
+
+        if (ok) {
+            if (!fingerprintKey.isEmpty())
+                m_fingerprints.insert(fingerprintKey, contentHash);
+            if (m_sources.value(memoKey) != contentHash) {
+                m_sources.insert(memoKey, contentHash);
+                ++m_unsaved;
+            }
+            ok = linkInto(contentHash, destPath);
+        }
+
+        if (!ok) {
+            qCWarning(lcMtpImport) << "failed to import" << path;
+            ++result.failed;
+            result.failedPaths << path;
+        }
+        if (m_unsaved >= kSaveInterval)
+            save();
+        if (progress)
+            progress(++done, files.size());
+    }
+
+    save();
+    qCDebug(lcMtpImport) << "imported" << result.imported << "new," << result.deduplicated
+                         << "duplicates," << result.failed << "failed," << result.bytesSaved << "bytes not transferred";
+    return result;
+}
@@ -0,0 +1,58 @@
+#ifndef MTPIMPORTSTORE_H
+#define MTPIMPORTSTORE_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include "imtdevice.h"
+
+struct MtpImportResult {
+    int imported = 0;       // new content, pulled in full
+    int deduplicated = 0;   // already in the store, only linked
+    int failed = 0;
+    quint64 bytesTransferred = 0;
+    quint64 bytesSaved = 0;
+    QStringList failedPaths;
+};
+
+// Content-addressed store for photo ingestion. Objects live once under
+// <root>/objects/<sha256> and every import destination is a hardlink into
+// it. Before pulling an object the store tries, in order:
+//   1. the source memo: same source, path, size and mtime as an earlier
+//      import. Costs nothing beyond the listing.
+//   2. the fingerprint: size + mtime + hash of the first and last 64 KB.
+//      Catches the same photo arriving from another phone for two small
+//      ranged reads.
+// Only objects that miss both are transferred in full.
+class MtpImportStore {
+public:
+    using ProgressCallback = std::function<void(int filesDone, int filesTotal)>;
+
+    explicit MtpImportStore(const QString &rootPath);
+    ~MtpImportStore();
+
+    bool isValid() const { return m_valid; }
+
+    // sourceKey identifies the device across sessions, e.g. its serial or
+    // friendly name; the device info string is used when it is empty.
+    MtpImportResult import(IMtpDevice *device, const QString &devicePath, const QString &destDir,
+                           const QString &sourceKey = QString(), const ProgressCallback &progress = ProgressCallback());
+
+    bool save();
+
+private:
+    QByteArray fingerprint(IMtpDevice *device, const MtpFileInfo &info);
+    bool pullIntoStore(IMtpDevice *device, const MtpFileInfo &info, QString &contentHash);
+    bool linkInto(const QString &contentHash, const QString &destPath);
+    QString objectPath(const QString &contentHash) const;
+    bool hasObject(const QString &contentHash) const;
+
+    QString m_rootPath;
+    bool m_valid;
+    int m_unsaved;
+    QHash<QString, QString> m_fingerprints; // fingerprint -> content hash
+    QHash<QString, QString> m_sources;      // source memo key -> content hash
+};
+
+#endif // MTPIMPORTSTORE_H
@@ -0,0 +1,78 @@
+#include "mtpobjectstream.h"
+#include <QDebug>
+#include <cstring>
+
+MtpObjectStream::MtpObjectStream(IMtpDevice *device, const QString &path, qint64 blockSize, int maxCachedBlocks, QObject *parent)
+    : QIODevice(parent)
+    , m_device(device)
+    , m_path(path)
+    , m_blockSize(qMax<qint64>(blockSize, 512))
+    , m_size(0)
+    , m_bytesFetched(0)
+    , m_blocks(qMax(maxCachedBlocks, 1))
+{
+}
+
+bool MtpObjectStream::open(OpenMode mode) {
+    if (mode & WriteOnly) {
+        setErrorString("MtpObjectStream is read-only");
+        return false;
+    }
+
+    MtpFileInfo info;
+    if (!m_device->statFile(m_path, info) || info.isDir) {
+        qWarning() << "MtpObjectStream: cannot open" << m_path;
+        setErrorString("No such object: " + m_path);
+        return false;
+    }
+    m_object = info;
+    m_size = static_cast<qint64>(info.size);
+    m_blocks.clear();
+
+    // QIODevice's own read buffer would duplicate the block cache.
+    return QIODevice::open(mode | Unbuffered);
+}
+
+const QByteArray *MtpObjectStream::block(qint64 index) {
+    if (QByteArray *cached = m_blocks.object(index))
+        return cached;
+
+    QByteArray *data = new QByteArray;
+    if (!m_device->readObjectRange(m_object, index * m_blockSize, m_blockSize, *data)) {
+        delete data;
+        return nullptr;
+    }
+    m_bytesFetched += data->size();
+    m_blocks.insert(index, data);
+    return m_blocks.object(index);
+}
+
+qint64 MtpObjectStream::readData(char *data, qint64 maxSize) {
+    qint64 position = pos();
+    qint64 copied = 0;
+
+    while (copied < maxSize && position < m_size) {
+        const QByteArray *current = block(position / m_blockSize);
+        if (!current) {
+            setErrorString("Failed to read " + m_path);
+            return copied > 0 ? copied : -1;
+        }
+
+        qint64 inBlock = position % m_blockSize;
+        qint64 available = current->size() - inBlock;
+        if (available <= 0)
+            break;
+
+        qint64 count = qMin(available, maxSize - copied);
+        std::memcpy(data + copied, current->constData() + inBlock, static_cast<size_t>(count));
+        copied += count;
+        position += count;
+    }
+    return copied;
+}
+
+qint64 MtpObjectStream::writeData(const char *data, qint64 maxSize) {
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
@@ -0,0 +1,43 @@
+#ifndef MTPOBJECTSTREAM_H
+#define MTPOBJECTSTREAM_H
+
+#include <QIODevice>
+#include <QCache>
+#include "imtdevice.h"
+
+// Seekable read-only view of a device object. The object is resolved once in
+// open(); data is then fetched with IMtpDevice::readObjectRange in aligned
+// blocks on demand and the most recently used blocks are kept, so header parsers that seek around (EXIF, MP4 atoms) only
+// transfer the parts of the object they actually touch.
+class MtpObjectStream : public QIODevice {
+    Q_OBJECT
+
+public:
+    explicit MtpObjectStream(IMtpDevice *device, const QString &path,
+                             qint64 blockSize = 64 * 1024, int maxCachedBlocks = 16,
+                             QObject *parent = nullptr);
+
+    bool open(OpenMode mode) override;
+    bool isSequential() const override { return false; }
+    qint64 size() const override { return m_size; }
+
+    QString path() const { return m_path; }
+    quint64 bytesFetched() const { return m_bytesFetched; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    const QByteArray *block(qint64 index);
+
+    IMtpDevice *m_device;
+    QString m_path;
+    MtpFileInfo m_object;
+    qint64 m_blockSize;
+    qint64 m_size;
+    quint64 m_bytesFetched;
+    QCache<qint64, QByteArray> m_blocks;
+};
+
+#endif // MTPOBJECTSTREAM_H
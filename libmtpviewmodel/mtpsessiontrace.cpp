@@ -0,0 +1,182 @@
+#include "mtpsessiontrace.h"
+#include <QCryptographicHash>
+
+namespace {
+
+void writeString(QDataStream &out, const QString &value) {
+    out << value.toUtf8();
+}
+
+QString readString(QDataStream &in) {
+    QByteArray utf8;
+    in >> utf8;
+    return QString::fromUtf8(utf8);
+}
+
+void writeInfo(QDataStream &out, const MtpFileInfo &info) {
+    out << info.objectId << info.size << info.modified.toSecsSinceEpoch() << info.isDir;
+}
+
+MtpFileInfo readInfo(QDataStream &in) {
+    MtpFileInfo info;
+    qint64 mtime = 0;
+    in >> info.objectId >> info.size >> mtime >> info.isDir;
+    info.modified = QDateTime::fromSecsSinceEpoch(mtime);
+    return info;
+}
+
+} // namespace
+
+namespace MtpSessionTrace {
+
+void writeHeader(QDataStream &out, bool storesContent) {
+    out.setVersion(QDataStream::Qt_6_0);
+    out << Magic << Version << quint8(storesContent ? 1 : 0);
+}
+
+bool readHeader(QDataStream &in, bool &storesContent) {
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint8 flags = 0;
+    in >> magic >> version >> flags;
+    storesContent = flags & 1;
+    return in.status() == QDataStream::Ok && magic == Magic && version == Version;
+}
+
+void writeRecord(QDataStream &out, const MtpSessionRecord &r) {
+    out << quint8(r.op) << r.startUs << r.durationUs << r.ok;
+
+    switch (r.op) {
+    case MtpSessionOp::DetectDevices:
+        out << quint32(r.devices.size());
+        for (const MtpDeviceInfo &device : r.devices) {
+            writeString(out, device.friendlyName);
+            writeString(out, device.mtpVersion);
+        }
+        break;
+    case MtpSessionOp::GetDeviceVersion:
+    case MtpSessionOp::GetDeviceInfo:
+        writeString(out, r.text);
+        break;
+    case MtpSessionOp::GetFreeSpace:
+        out << r.value;
+        break;
+    case MtpSessionOp::GetFileList:
+        writeString(out, r.path);
+        out << quint32(r.list.size());
+        for (const QString &entry : r.list)
+            writeString(out, entry);
+        break;
+    case MtpSessionOp::StatFile:
+        writeString(out, r.path);
+        writeInfo(out, r.info);
+        break;
+    case MtpSessionOp::GetFileInfoList:
+        writeString(out, r.path);
+        out << quint32(r.infos.size());
+        for (const MtpFileInfo &info : r.infos) {
+            writeString(out, info.path);
+            writeInfo(out, info);
+        }
+        break;
+    case MtpSessionOp::ReadRange:
+        writeString(out, r.path);
+        out << r.offset << r.length << r.value << r.digest << r.content;
+        break;
+    case MtpSessionOp::ReadFile:
+        writeString(out, r.path);
+        out << r.value << r.digest << r.content;
+        break;
+    case MtpSessionOp::WriteFile:
+        writeString(out, r.path);
+        out << r.value << r.digest;
+        break;
+    case MtpSessionOp::DeleteFile:
+    case MtpSessionOp::CreateDirectory:
+    case MtpSessionOp::DeleteDirectory:
+        writeString(out, r.path);
+        break;
+    }
+}
+
+bool readRecord(QDataStream &in, MtpSessionRecord &r) {
+    r = MtpSessionRecord();
+    quint8 op = 0;
+    in >> op >> r.startUs >> r.durationUs >> r.ok;
+    if (in.status() != QDataStream::Ok)
+        return false;
+    r.op = MtpSessionOp(op);
+
+    switch (r.op) {
+    case MtpSessionOp::DetectDevices: {
+        quint32 count = 0;
+        in >> count;
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            MtpDeviceInfo device;
+            device.friendlyName = readString(in);
+            device.mtpVersion = readString(in);
+            r.devices.append(device);
+        }
+        break;
+    }
+    case MtpSessionOp::GetDeviceVersion:
+    case MtpSessionOp::GetDeviceInfo:
+        r.text = readString(in);
+        break;
+    case MtpSessionOp::GetFreeSpace:
+        in >> r.value;
+        break;
+    case MtpSessionOp::GetFileList: {
+        r.path = readString(in);
+        quint32 count = 0;
+        in >> count;
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+            r.list << readString(in);
+        break;
+    }
+    case MtpSessionOp::StatFile:
+        r.path = readString(in);
+        r.info = readInfo(in);
+        r.info.path = r.path;
+        break;
+    case MtpSessionOp::GetFileInfoList: {
+        r.path = readString(in);
+        quint32 count = 0;
+        in >> count;
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            const QString path = readString(in);
+            MtpFileInfo info = readInfo(in);
+            info.path = path;
+            r.infos.append(info);
+        }
+        break;
+    }
+    case MtpSessionOp::ReadRange:
+        r.path = readString(in);
+        in >> r.offset >> r.length >> r.value >> r.digest >> r.content;
+        break;
+    case MtpSessionOp::ReadFile:
+        r.path = readString(in);
+        in >> r.value >> r.digest >> r.content;
+        break;
+    case MtpSessionOp::WriteFile:
+        r.path = readString(in);
+        in >> r.value >> r.digest;
+        break;
+    case MtpSessionOp::DeleteFile:
+    case MtpSessionOp::CreateDirectory:
+    case MtpSessionOp::DeleteDirectory:
+        r.path = readString(in);
+        break;
+    default:
+        return false;
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+QByteArray digest(const QByteArray &content) {
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+}
+
+} // namespace MtpSessionTrace
@@ -0,0 +1,66 @@
+#ifndef MTPSESSIONTRACE_H
+#define MTPSESSIONTRACE_H
+
+#include <QDataStream>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include "imtdevice.h"
+
+// Binary format shared by RecordingMtpDevice and ReplayMtpDevice: a header
+// followed by one record per IMtpDevice call in completion order. Object
+// content is stored as a SHA-1 digest and length unless the trace was
+// recorded with content.
+
+enum class MtpSessionOp : quint8 {
+    DetectDevices = 1,
+    GetDeviceVersion,
+    GetDeviceInfo,
+    GetFreeSpace,
+    GetFileList,
+    StatFile,
+    ReadFile,
+    ReadRange,
+    WriteFile,
+    DeleteFile,
+    CreateDirectory,
+    DeleteDirectory,
+    GetFileInfoList
+};
+
+struct MtpSessionRecord {
+    MtpSessionOp op = MtpSessionOp::DetectDevices;
+    qint64 startUs = 0;    // since the session started
+    qint64 durationUs = 0;
+    QString path;
+    quint64 offset = 0;
+    quint64 length = 0;
+    bool ok = false;
+
+    QString text;          // getDeviceVersion / getDeviceInfo
+    quint64 value = 0;     // getFreeSpace, or payload size for reads and writes
+    QStringList list;      // getFileList
+    QVector<MtpFileInfo> infos; // getFileInfoList
+    QVector<MtpDeviceInfo> devices;
+    MtpFileInfo info;
+    QByteArray digest;
+    QByteArray content;    // reads only, and only in traces with stored content
+};
+
+namespace MtpSessionTrace {
+
+constexpr quint32 Magic = 0x4d545052; // "MTPR"
+constexpr quint16 Version = 1;
+
+void writeHeader(QDataStream &out, bool storesContent);
+bool readHeader(QDataStream &in, bool &storesContent);
+
+void writeRecord(QDataStream &out, const MtpSessionRecord &record);
+bool readRecord(QDataStream &in, MtpSessionRecord &record);
+
+QByteArray digest(const QByteArray &content);
+
+} // namespace MtpSessionTrace
+
+#endif // MTPSESSIONTRACE_H
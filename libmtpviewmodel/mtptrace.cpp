@@ -0,0 +1,286 @@
+#include "mtptrace.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+#include <QtAlgorithms>
+#include <chrono>
+
+namespace {
+
+constexpr int kRingSize = 4096;
+constexpr int kMaxOperations = 256;
+constexpr int kBuckets = 64;
+
+// One event in a ring. seq is odd while the owning thread rewrites the slot,
+// readers retry or skip a slot whose seq changed under them.
+struct TraceSlot {
+    std::atomic<quint64> seq{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<const char *> category{nullptr};
+    std::atomic<qint64> startNs{0};
+    std::atomic<qint64> durationNs{0};
+    std::atomic<quint64> bytes{0};
+};
+
+struct ThreadRing {
+    int tid = 0;
+    std::atomic<quint64> head{0};
+    std::atomic<quint64> cleared{0};
+    TraceSlot events[kRingSize];
+};
+
+struct OperationStats {
+    std::atomic<const char *> name;
+    std::atomic<quint64> count;
+    std::atomic<quint64> bytes;
+    std::atomic<quint64> totalNs;
+    std::atomic<quint64> buckets[kBuckets]; // bucket b counts durations in [2^(b-1), 2^b) ns
+};
+
+// Static storage, so every atomic starts out zeroed.
+OperationStats g_operations[kMaxOperations];
+
+QMutex &registryMutex() {
+    static QMutex mutex;
+    return mutex;
+}
+
+QVector<ThreadRing *> &registry() {
+    static QVector<ThreadRing *> rings;
+    return rings;
+}
+
+// Rings of exited threads, ready for the next thread that records.
+QVector<ThreadRing *> &freeRings() {
+    static QVector<ThreadRing *> rings;
+    return rings;
+}
+
+// Hands the thread's ring back when the thread exits. Pool threads expire
+// and get recreated, so without this every new thread would add a ring.
+// A recycled ring stays registered and keeps its older events until they
+// are overwritten, so the exporter can still read them.
+struct RingLease {
+    ThreadRing *ring = nullptr;
+
+    ~RingLease() {
+        if (ring) {
+            QMutexLocker locker(&registryMutex());
+            freeRings().append(ring);
+        }
+    }
+};
+
+thread_local RingLease t_lease;
+
+ThreadRing *currentRing() {
+    if (!t_lease.ring) {
+        QMutexLocker locker(&registryMutex());
+        if (!freeRings().isEmpty()) {
+            t_lease.ring = freeRings().takeLast();
+        } else {
+            ThreadRing *ring = new ThreadRing;
+            ring->tid = registry().size() + 1;
+            registry().append(ring);
+            t_lease.ring = ring;
+        }
+    }
+    return t_lease.ring;
+}
+
+OperationStats *statsFor(const char *name) {
+    const quintptr hash = reinterpret_cast<quintptr>(name) >> 3;
+    for (int i = 0; i < kMaxOperations; ++i) {
+        OperationStats &slot = g_operations[(hash + i) % kMaxOperations];
+        const char *current = slot.name.load(std::memory_order_acquire);
+        if (current == name)
+            return &slot;
+        if (!current) {
+            const char *expected = nullptr;
+            if (slot.name.compare_exchange_strong(expected, name, std::memory_order_acq_rel) || expected == name)
+                return &slot;
+        }
+    }
+    return nullptr;
+}
+
+int bucketFor(qint64 durationNs) {
+    if (durationNs <= 0)
+        return 0;
+    return qMin(kBuckets - 1, 64 - int(qCountLeadingZeroBits(quint64(durationNs))));
+}
+
+struct Aggregate {
+    quint64 count = 0;
+    quint64 bytes = 0;
+    quint64 totalNs = 0;
+    quint64 buckets[kBuckets] = {};
+};
+
+double percentileUs(const Aggregate &aggregate, double fraction) {
+    const quint64 target = qMax<quint64>(1, quint64(aggregate.count * fraction + 0.5));
+    quint64 seen = 0;
+    for (int b = 0; b < kBuckets; ++b) {
+        seen += aggregate.buckets[b];
+        if (seen >= target)
+            return double(quint64(1) << b) / 1000.0;
+    }
+    return 0.0;
+}
+
+} // namespace
+
+std::atomic<bool> MtpTrace::s_enabled{qEnvironmentVariableIntValue("MTP_TRACE") != 0};
+
+void MtpTrace::setEnabled(bool enabled) {
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 MtpTrace::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MtpTrace::record(const char *name, const char *category, qint64 startNs, qint64 durationNs, quint64 bytes) {
+    ThreadRing *ring = currentRing();
+    const quint64 head = ring->head.load(std::memory_order_relaxed);
+    TraceSlot &slot = ring->events[head % kRingSize];
+
+    slot.seq.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.category.store(category, std::memory_order_relaxed);
+    slot.startNs.store(startNs, std::memory_order_relaxed);
+    slot.durationNs.store(durationNs, std::memory_order_relaxed);
+    slot.bytes.store(bytes, std::memory_order_relaxed);
+    slot.seq.store(2 * head + 2, std::memory_order_release);
+    ring->head.store(head + 1, std::memory_order_release);
+
+    if (OperationStats *stats = statsFor(name)) {
+        stats->count.fetch_add(1, std::memory_order_relaxed);
+        stats->bytes.fetch_add(bytes, std::memory_order_relaxed);
+        stats->totalNs.fetch_add(quint64(qMax<qint64>(durationNs, 0)), std::memory_order_relaxed);
+        stats->buckets[bucketFor(durationNs)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+QByteArray MtpTrace::exportChromeTrace() {
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+
+    QMutexLocker locker(&registryMutex());
+    for (ThreadRing *ring : std::as_const(registry())) {
+        QJsonObject threadName;
+        threadName["name"] = "thread_name";
+        threadName["ph"] = "M";
+        threadName["pid"] = pid;
+        threadName["tid"] = ring->tid;
+        threadName["args"] = QJsonObject{{"name", QString("mtp thread %1").arg(ring->tid)}};
+        events.append(threadName);
+
+        const quint64 head = ring->head.load(std::memory_order_acquire);
+        const quint64 cleared = ring->cleared.load(std::memory_order_relaxed);
+        const quint64 first = qMax(cleared, head > kRingSize ? head - kRingSize : 0);
+
+        for (quint64 i = first; i < head; ++i) {
+            const TraceSlot &slot = ring->events[i % kRingSize];
+            const quint64 seq = slot.seq.load(std::memory_order_acquire);
+            if (seq != 2 * i + 2)
+                continue;
+            const char *name = slot.name.load(std::memory_order_relaxed);
+            const char *category = slot.category.load(std::memory_order_relaxed);
+            const qint64 startNs = slot.startNs.load(std::memory_order_relaxed);
+            const qint64 durationNs = slot.durationNs.load(std::memory_order_relaxed);
+            const quint64 bytes = slot.bytes.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq)
+                continue;
+
+            QJsonObject event;
+            event["name"] = QString::fromLatin1(name);
+            event["cat"] = QString::fromLatin1(category);
+            event["ph"] = "X";
+            event["ts"] = startNs / 1000.0;
+            event["dur"] = durationNs / 1000.0;
+            event["pid"] = pid;
+            event["tid"] = ring->tid;
+            if (bytes > 0)
+                event["args"] = QJsonObject{{"bytes", double(bytes)}};
+            events.append(event);
+        }
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+QByteArray MtpTrace::exportHistograms() {
+    // The same literal can live at different addresses in different
+    // translation units, so merge by name before reporting.
+    QMap<QString, Aggregate> merged;
+    for (const OperationStats &stats : g_operations) {
+        const char *name = stats.name.load(std::memory_order_acquire);
+        if (!name)
+            continue;
+        Aggregate &aggregate = merged[QString::fromLatin1(name)];
+        aggregate.count += stats.count.load(std::memory_order_relaxed);
+        aggregate.bytes += stats.bytes.load(std::memory_order_relaxed);
+        aggregate.totalNs += stats.totalNs.load(std::memory_order_relaxed);
+        for (int b = 0; b < kBuckets; ++b)
+            aggregate.buckets[b] += stats.buckets[b].load(std::memory_order_relaxed);
+    }
+
+    QJsonObject operations;
+    for (auto it = merged.cbegin(); it != merged.cend(); ++it) {
+        const Aggregate &aggregate = it.value();
+        if (aggregate.count == 0)
+            continue;
+
+        QJsonArray buckets;
+        for (int b = 0; b < kBuckets; ++b) {
+            if (aggregate.buckets[b] > 0)
+                buckets.append(QJsonArray{double(quint64(1) << b) / 1000.0, double(aggregate.buckets[b])});
+        }
+
+        QJsonObject op;
+        op["count"] = double(aggregate.count);
+        op["bytes"] = double(aggregate.bytes);
+        op["meanUs"] = aggregate.totalNs / 1000.0 / aggregate.count;
+        op["p50Us"] = percentileUs(aggregate, 0.50);
+        op["p90Us"] = percentileUs(aggregate, 0.90);
+        op["p99Us"] = percentileUs(aggregate, 0.99);
+        op["buckets"] = buckets; // [upper bound in us, count]
+        operations[it.key()] = op;
+    }
+    return QJsonDocument(operations).toJson(QJsonDocument::Indented);
+}
+
+bool MtpTrace::writeChromeTrace(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    return file.write(exportChromeTrace()) >= 0;
+}
+
+void MtpTrace::reset() {
+    {
+        QMutexLocker locker(&registryMutex());
+        for (ThreadRing *ring : std::as_const(registry()))
+            ring->cleared.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+
+    for (OperationStats &stats : g_operations) {
+        stats.count.store(0, std::memory_order_relaxed);
+        stats.bytes.store(0, std::memory_order_relaxed);
+        stats.totalNs.store(0, std::memory_order_relaxed);
+        for (int b = 0; b < kBuckets; ++b)
+            stats.buckets[b].store(0, std::memory_order_relaxed);
+    }
+}
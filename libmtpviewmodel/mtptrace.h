@@ -0,0 +1,64 @@
+#ifndef MTPTRACE_H
+#define MTPTRACE_H
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+
+// Low overhead tracing of device calls and view model stages.
+//
+// Spans are written to a per-thread ring buffer without locks and folded into
+// per-operation latency histograms. When tracing is off a span is a single
+// relaxed atomic load. Tracing starts enabled when MTP_TRACE=1 is set in the
+// environment and can be toggled at any time with setEnabled().
+class MtpTrace {
+public:
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    static qint64 nowNs();
+    // name and category must be string literals, only the pointers are stored.
+    static void record(const char *name, const char *category, qint64 startNs, qint64 durationNs, quint64 bytes = 0);
+
+    // Chrome trace-event JSON, loadable in chrome://tracing or Perfetto.
+    static QByteArray exportChromeTrace();
+    // Per-operation count, bytes and latency percentiles as JSON.
+    static QByteArray exportHistograms();
+    static bool writeChromeTrace(const QString &fileName);
+    static void reset();
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+class MtpTraceSpan {
+public:
+    explicit MtpTraceSpan(const char *name, const char *category = "mtp")
+        : m_name(name), m_category(category), m_bytes(0), m_active(MtpTrace::isEnabled())
+    {
+        m_startNs = m_active ? MtpTrace::nowNs() : 0;
+    }
+
+    ~MtpTraceSpan() {
+        if (m_active)
+            MtpTrace::record(m_name, m_category, m_startNs, MtpTrace::nowNs() - m_startNs, m_bytes);
+    }
+
+    void addBytes(quint64 bytes) { m_bytes += bytes; }
+
+    MtpTraceSpan(const MtpTraceSpan &) = delete;
+    MtpTraceSpan &operator=(const MtpTraceSpan &) = delete;
+
+private:
+    const char *m_name;
+    const char *m_category;
+    qint64 m_startNs;
+    quint64 m_bytes;
+    bool m_active;
+};
+
+#define MTP_TRACE_CONCAT_INNER(a, b) a##b
+#define MTP_TRACE_CONCAT(a, b) MTP_TRACE_CONCAT_INNER(a, b)
+#define MTP_TRACE_SPAN(name, category) MtpTraceSpan MTP_TRACE_CONCAT(mtpTraceSpan, __LINE__)(name, category)
+
+#endif // MTPTRACE_H
@@ -0,0 +1,283 @@
+#include "mtptransferjob.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QDebug>
+#include <unistd.h>
+
+MtpTransferJournal::MtpTransferJournal(const QString &fileName)
+    : m_fileName(fileName)
+{
+}
+
+bool MtpTransferJournal::load() {
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        qWarning() << "MtpTransferJournal: ignoring corrupt journal" << m_fileName << error.errorString();
+        return false;
+    }
+
+    m_entries.clear();
+    const QJsonArray entries = doc.object().value("entries").toArray();
+    for (const QJsonValue &value : entries) {
+        const QJsonObject obj = value.toObject();
+        MtpTransferEntry entry;
+        entry.direction = obj.value("direction").toString() == "push" ? MtpTransferEntry::Push : MtpTransferEntry::Pull;
+        entry.devicePath = obj.value("devicePath").toString();
+        entry.localPath = obj.value("localPath").toString();
+        entry.totalSize = static_cast<quint64>(obj.value("totalSize").toDouble());
+        entry.confirmedOffset = static_cast<quint64>(obj.value("confirmedOffset").toDouble());
+        entry.mtime = static_cast<qint64>(obj.value("mtime").toDouble());
+        entry.done = obj.value("done").toBool();
+        entry.failed = obj.value("failed").toBool();
+        m_entries.append(entry);
+    }
+    return true;
+}
+
+bool MtpTransferJournal::save() const {
+    QJsonArray entries;
+    for (const MtpTransferEntry &entry : m_entries) {
+        QJsonObject obj;
+        obj["direction"] = entry.direction == MtpTransferEntry::Push ? "push" : "pull";
+        obj["devicePath"] = entry.devicePath;
+        obj["localPath"] = entry.localPath;
+        obj["totalSize"] = static_cast<double>(entry.totalSize);
+        obj["confirmedOffset"] = static_cast<double>(entry.confirmedOffset);
+        obj["mtime"] = static_cast<double>(entry.mtime);
+        obj["done"] = entry.done;
+        obj["failed"] = entry.failed;
+        entries.append(obj);
+    }
+
+    QJsonObject root;
+    root["version"] = 1;
+    root["entries"] = entries;
+
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "MtpTransferJournal: cannot write" << m_fileName;
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+void MtpTransferJournal::remove() {
+    QFile::remove(m_fileName);
+}
+
+
+MtpTransferJob::MtpTransferJob(IMtpDevice *device, const QString &journalPath, quint64 chunkSize)
+    : m_device(device)
+    , m_journal(journalPath)
+    , m_chunkSize(qMax<quint64>(chunkSize, 4096))
+    , m_retryAttempts(3)
+    , m_retryDelayMs(1000)
+    , m_cancelled(false)
+{
+}
+
+bool MtpTransferJob::resume() {
+    return m_journal.load();
+}
+
+void MtpTransferJob::addPull(const QString &devicePath, const QString &localPath) {
+    MtpTransferEntry entry;
+    entry.direction = MtpTransferEntry::Pull;
+    entry.devicePath = devicePath;
+    entry.localPath = localPath;
+    m_journal.entries().append(entry);
+}
+
+void MtpTransferJob::addPush(const QString &localPath, const QString &devicePath) {
+    MtpTransferEntry entry;
+    entry.direction = MtpTransferEntry::Push;
+    entry.devicePath = devicePath;
+    entry.localPath = localPath;
+    m_journal.entries().append(entry);
+}
+
+void MtpTransferJob::setRetryPolicy(int attempts, int delayMs) {
+    m_retryAttempts = qMax(0, attempts);
+    m_retryDelayMs = qMax(0, delayMs);
+}
+
+bool MtpTransferJob::hasPendingWork() const {
+    for (const MtpTransferEntry &entry : m_journal.entries()) {
+        if (!entry.done && !entry.failed)
+            return true;
+    }
+    return false;
+}
+
+QStringList MtpTransferJob::failedPaths() const {
+    QStringList paths;
+    for (const MtpTransferEntry &entry : m_journal.entries()) {
+        if (entry.failed)
+            paths << entry.devicePath;
+    }
+    return paths;
+}
+
+MtpTransferStatus MtpTransferJob::run(const ProgressCallback &progress) {
+    m_cancelled = false;
+    bool anyFailed = false;
+
+    // Everything queued since the last run is recorded in one write.
+    if (!m_journal.save())
+        return MtpTransferStatus::Failed;
+
+    for (MtpTransferEntry &entry : m_journal.entries()) {
+        if (entry.done || entry.failed)
+            continue;
+        if (m_cancelled) {
+            m_journal.save();
+            return MtpTransferStatus::Interrupted;
+        }
+
+        MtpTransferStatus status = entry.direction == MtpTransferEntry::Pull ? pull(entry, progress)
+                                                                             : push(entry, progress);
+        if (status == MtpTransferStatus::Interrupted) {
+            qWarning() << "MtpTransferJob: interrupted at" << entry.devicePath << "offset" << entry.confirmedOffset;
+            m_journal.save();
+            return status;
+        }
+        if (status == MtpTransferStatus::Failed) {
+            qWarning() << "MtpTransferJob: giving up on" << entry.devicePath;
+            entry.failed = true;
+            anyFailed = true;
+        }
+        m_journal.save();
+    }
+
+    if (anyFailed)
+        return MtpTransferStatus::Failed;
+    m_journal.remove();
+    return MtpTransferStatus::Completed;
+}
+
+template <typename Operation>
+bool MtpTransferJob::withRetries(Operation operation) {
+    for (int attempt = 0; attempt <= m_retryAttempts; ++attempt) {
+        if (attempt > 0) {
+            if (m_cancelled)
+                return false;
+            QThread::msleep(m_retryDelayMs);
+        }
+        if (operation())
+            return true;
+    }
+    return false;
+}
+
+MtpTransferStatus MtpTransferJob::pull(MtpTransferEntry &entry, const ProgressCallback &progress) {
+    MtpFileInfo info;
+    if (!withRetries([&]() { return m_device->statFile(entry.devicePath, info); })) {
+        // A missing object and a missing device look the same to statFile.
+        return m_device->detectDevices().isEmpty() ? MtpTransferStatus::Interrupted
+                                                   : MtpTransferStatus::Failed;
+    }
+    if (info.isDir)
+        return MtpTransferStatus::Failed;
+
+    // Object IDs are reassigned when the device reconnects, which is when
+    // resuming matters, so the object is recognised by path, size and mtime.
+    // The ID only addresses the chunk reads of this session.
+    const qint64 mtime = info.modified.toSecsSinceEpoch();
+    if (entry.confirmedOffset > 0 && (entry.mtime != mtime || entry.totalSize != info.size)) {
+        qWarning() << "MtpTransferJob:" << entry.devicePath << "changed on the device, restarting";
+        entry.confirmedOffset = 0;
+    }
+    entry.mtime = mtime;
+    entry.totalSize = info.size;
+
+    QDir().mkpath(QFileInfo(entry.localPath).absolutePath());
+    QFile part(entry.localPath + ".part");
+    if (!part.open(QIODevice::ReadWrite))
+        return MtpTransferStatus::Failed;
+
+    // Anything past the confirmed offset may be torn; drop it.
+    if (static_cast<quint64>(part.size()) < entry.confirmedOffset)
+        entry.confirmedOffset = static_cast<quint64>(part.size());
+    if (!part.resize(static_cast<qint64>(entry.confirmedOffset)) || !part.seek(static_cast<qint64>(entry.confirmedOffset)))
+        return MtpTransferStatus::Failed;
+
+    while (entry.confirmedOffset < entry.totalSize) {
+        if (m_cancelled)
+            return MtpTransferStatus::Interrupted;
+
+        QByteArray chunk;
+        bool read = withRetries([&]() {
+            return m_device->readObjectRange(info, entry.confirmedOffset, m_chunkSize, chunk) && !chunk.isEmpty();
+        });
+        if (!read) {
+            // A device that came back within the retries answers the stat
+            // with a new ID for the same object; carry on from there.
+            MtpFileInfo current;
+            if (m_device->statFile(entry.devicePath, current)) {
+                // Still there under the same ID: the object itself fails,
+                // and the batch moves on without it.
+                if (current.objectId == info.objectId)
+                    return MtpTransferStatus::Failed;
+                info = current;
+                if (info.modified.toSecsSinceEpoch() != entry.mtime || info.size != entry.totalSize) {
+                    qWarning() << "MtpTransferJob:" << entry.devicePath << "changed on the device, restarting";
+                    entry.confirmedOffset = 0;
+                    entry.mtime = info.modified.toSecsSinceEpoch();
+                    entry.totalSize = info.size;
+                    if (!part.resize(0) || !part.seek(0))
+                        return MtpTransferStatus::Failed;
+                }
+                continue;
+            }
+            return m_device->detectDevices().isEmpty() ? MtpTransferStatus::Interrupted
+                                                       : MtpTransferStatus::Failed;
+        }
+
+        if (part.write(chunk) != chunk.size() || !part.flush() || ::fsync(part.handle()) != 0)
+            return MtpTransferStatus::Failed;
+
+        entry.confirmedOffset += chunk.size();
+        m_journal.save();
+        if (progress)
+            progress(entry.devicePath, entry.confirmedOffset, entry.totalSize);
+    }
+    part.close();
+
+    QFile::remove(entry.localPath);
+    if (!part.rename(entry.localPath))
+        return MtpTransferStatus::Failed;
+
+    entry.done = true;
+    return MtpTransferStatus::Completed;
+}
+
+MtpTransferStatus MtpTransferJob::push(MtpTransferEntry &entry, const ProgressCallback &progress) {
+    QFile local(entry.localPath);
+    if (!local.open(QIODevice::ReadOnly))
+        return MtpTransferStatus::Failed;
+
+    const QByteArray data = local.readAll();
+    entry.totalSize = static_cast<quint64>(data.size());
+
+    if (!withRetries([&]() { return m_device->writeFile(entry.devicePath, data); })) {
+        return m_device->detectDevices().isEmpty() ? MtpTransferStatus::Interrupted
+                                                   : MtpTransferStatus::Failed;
+    }
+
+    entry.done = true;
+    if (progress)
+        progress(entry.devicePath, entry.totalSize, entry.totalSize);
+    return MtpTransferStatus::Completed;
+}
@@ -0,0 +1,87 @@
+#ifndef MTPTRANSFERJOB_H
+#define MTPTRANSFERJOB_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include "imtdevice.h"
+
+enum class MtpTransferStatus {
+    Completed,
+    Failed,      // at least one object can't be transferred, retrying won't help
+    Interrupted  // the device stopped answering; run() again after reconnect
+};
+
+struct MtpTransferEntry {
+    enum Direction { Pull, Push };
+
+    Direction direction = Pull;
+    QString devicePath;
+    QString localPath;
+    quint64 totalSize = 0;
+    quint64 confirmedOffset = 0; // pull only: bytes known to be on disk in the .part file
+    qint64 mtime = 0;            // with devicePath and totalSize, what the confirmed bytes belong to
+    bool done = false;
+    bool failed = false;
+};
+
+// On-disk record of a transfer batch. Rewritten atomically after each
+// confirmed chunk, so a crash or unplug loses at most the chunk in flight.
+class MtpTransferJournal {
+public:
+    explicit MtpTransferJournal(const QString &fileName);
+
+    bool load();
+    bool save() const;
+    void remove();
+
+    QString fileName() const { return m_fileName; }
+    QVector<MtpTransferEntry> &entries() { return m_entries; }
+    const QVector<MtpTransferEntry> &entries() const { return m_entries; }
+
+private:
+    QString m_fileName;
+    QVector<MtpTransferEntry> m_entries;
+};
+
+// A batch of pulls and pushes that survives disconnects. Pulls are fetched in
+// ranged chunks into "<localPath>.part" and resume from the last confirmed
+// offset; pushes are whole objects, so only the object that failed is sent
+// again. Objects that completed in an earlier run are never redone.
+class MtpTransferJob {
+public:
+    using ProgressCallback = std::function<void(const QString &devicePath, quint64 done, quint64 total)>;
+
+    MtpTransferJob(IMtpDevice *device, const QString &journalPath, quint64 chunkSize = 8 * 1024 * 1024);
+
+    // Picks up the journal of an earlier, unfinished run if there is one.
+    bool resume();
+
+    // Queued in memory; run() writes the journal once before transferring.
+    void addPull(const QString &devicePath, const QString &localPath);
+    void addPush(const QString &localPath, const QString &devicePath);
+
+    void setRetryPolicy(int attempts, int delayMs);
+    MtpTransferStatus run(const ProgressCallback &progress = ProgressCallback());
+    void cancel() { m_cancelled = true; }
+
+    bool hasPendingWork() const;
+    QStringList failedPaths() const;
+
+private:
+    MtpTransferStatus pull(MtpTransferEntry &entry, const ProgressCallback &progress);
+    MtpTransferStatus push(MtpTransferEntry &entry, const ProgressCallback &progress);
+    template <typename Operation>
+    bool withRetries(Operation operation);
+
+    IMtpDevice *m_device;
+    MtpTransferJournal m_journal;
+    quint64 m_chunkSize;
+    int m_retryAttempts;
+    int m_retryDelayMs;
+    std::atomic<bool> m_cancelled;
+};
+
+#endif // MTPTRANSFERJOB_H
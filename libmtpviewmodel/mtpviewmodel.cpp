@@ -1,32 +1,84 @@
 #include "mtpviewmodel.h"
+#include "mtpexporter.h"
+#include "mtptrace.h"
 //#include "mtpdevice.h"
 #include <QtConcurrent>
 #include <QFutureWatcher>
+#include <QDateTime>
+#include <QLoggingCategory>
+#include <memory>
+
+Q_LOGGING_CATEGORY(lcMtpViewModel, "mtp.viewmodel", QtWarningMsg)
+
+namespace {
+
+// Time a job spent waiting for a pool thread, recorded from the worker side.
+void traceQueueWait(qint64 queuedAtNs) {
+    if (queuedAtNs != 0 && MtpTrace::isEnabled())
+        MtpTrace::record("vm.queueWait", "viewmodel", queuedAtNs, MtpTrace::nowNs() - queuedAtNs);
+}
+
+struct RefreshSnapshot {
+    QString deviceInfo;
+    QString freeSpace;
+    QStringList files;
+    MtpDirectoryRollup rollup;
+};
+
+struct WrittenFile {
+    bool stated = false;
+    MtpFileInfo info;
+};
+
+// One listing with sizes feeds both the tree and the rollup, so the two
+// always agree, and the bottom-up pass runs on the worker rather than on
+// the GUI thread.
+void listInto(IMtpDevice *device, RefreshSnapshot &snapshot) {
+    const QVector<MtpFileInfo> infos = device->getFileInfoList();
+    snapshot.files.reserve(infos.size());
+    for (const MtpFileInfo &info : infos)
+        snapshot.files << info.path;
+    MTP_TRACE_SPAN("vm.buildRollup", "viewmodel");
+    snapshot.rollup.build(infos);
+}
+
+} // namespace
 
 MtpViewModel::MtpViewModel(IMtpDevice *device, QObject *parent)
-    : QObject(parent),m_device(device), m_isBusy(false)
+    : QObject(parent),m_device(device), m_isBusy(false), m_freeSpace("Unknown")
 {
     refreshDevice();
 }
 
 MtpViewModel::~MtpViewModel() {
+    // Running jobs capture this, so they have to finish before it goes.
+    const auto watchers = findChildren<QFutureWatcherBase *>(Qt::FindDirectChildrenOnly);
+    for (QFutureWatcherBase *watcher : watchers)
+        watcher->waitForFinished();
+}
+
+// Claims the view model for one operation. The check and the set are a
+// single compare-exchange so two callers can't both see "not busy".
+bool MtpViewModel::tryBeginOperation() {
+    bool expected = false;
+    if (!m_isBusy.compare_exchange_strong(expected, true))
+        return false;
+    emit busyChanged(true);
+    return true;
 }
 
 void MtpViewModel::setBusy(bool busy) {
-    if (m_isBusy != busy) {
-        m_isBusy = busy;
-        emit busyChanged(m_isBusy);
-    }
+    if (m_isBusy.exchange(busy) != busy)
+        emit busyChanged(busy);
 }
 
 
 QString MtpViewModel::deviceInfo() const {
-    return m_device->getDeviceInfo() + " (" + m_device->getDeviceVersion() + ")";
+    return m_deviceInfo;
 }
 
 QString MtpViewModel::freeSpace() const {
-    quint64 bytes = m_device->getFreeSpace();
-    return bytes > 0 ? QString::number(bytes / (1024 * 1024)) + " MB" : "Unknown";
+    return m_freeSpace;
 }
 
 QStringList MtpViewModel::fileList() {
@@ -38,111 +90,144 @@ QStringList MtpViewModel::fileList(const QString &path) {
 }
 
 void MtpViewModel::refreshDevice() {
-    if (m_isBusy) {
-        qDebug() << "ViewModel is busy, refresh skipped.";
+    if (!tryBeginOperation()) {
+        qCDebug(lcMtpViewModel) << "ViewModel is busy, refresh skipped.";
         emit operationFailed("Operation skipped: Another operation is in progress.");
         return;
     }
-    setBusy(true);
-    qDebug() << "Refreshing device info and file list...";
+    qCDebug(lcMtpViewModel) << "Refreshing device info and file list...";
 
-    QFutureWatcher<void> *watcher = new QFutureWatcher<void>(this);
-    connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher]() {
-        qDebug() << "Device info and file list refresh finished.";
+    QFutureWatcher<RefreshSnapshot> *watcher = new QFutureWatcher<RefreshSnapshot>(this);
+    connect(watcher, &QFutureWatcher<RefreshSnapshot>::finished, this, [this, watcher]() {
+        qCDebug(lcMtpViewModel) << "Device info and file list refresh finished.";
+        RefreshSnapshot snapshot = watcher->result();
+        m_rollup = std::move(snapshot.rollup);
+        m_deviceInfo = snapshot.deviceInfo;
+        m_freeSpace = snapshot.freeSpace;
         emit deviceUpdated();
-        emit fileListUpdated(m_device->getFileList());
+        emit directoryStatsUpdated();
+        emit fileListUpdated(snapshot.files);
         setBusy(false);
         watcher->deleteLater();
     });
 
-    QFuture<void> future = QtConcurrent::run([this]() {
+    const qint64 queuedAt = MtpTrace::isEnabled() ? MtpTrace::nowNs() : 0;
+    QFuture<RefreshSnapshot> future = QtConcurrent::run([this, queuedAt]() {
+        traceQueueWait(queuedAt);
+        MTP_TRACE_SPAN("vm.refreshDevice", "viewmodel");
 
-        QString deviceInfo = m_device->getDeviceInfo() + " (" + m_device->getDeviceVersion() + ")";
+        RefreshSnapshot snapshot;
+        snapshot.deviceInfo = m_device->getDeviceInfo() + " (" + m_device->getDeviceVersion() + ")";
         quint64 bytes = m_device->getFreeSpace();
-        QString freeSpace = bytes > 0 ? QString::number(bytes / (1024 * 1024)) + " MB" : "Unknown";
+        snapshot.freeSpace = bytes > 0 ? QString::number(bytes / (1024 * 1024)) + " MB" : "Unknown";
+
+        qCDebug(lcMtpViewModel) << "Device Info:" << snapshot.deviceInfo;
+        qCDebug(lcMtpViewModel) << "Free Space:" << snapshot.freeSpace;
 
-        qDebug() << "Device Info:" << deviceInfo;
-        qDebug() << "Free Space:" << freeSpace;
+        listInto(m_device, snapshot);
+        return snapshot;
     });
     watcher->setFuture(future);
-    watcher->setFuture(future);
 }
 
 
 
-void MtpViewModel::runAsyncOperation(std::function<bool()> operation, const QString& successMessage, const QString& failureMessageBase) {
-    if (m_isBusy) {
-        qDebug() << "ViewModel is busy, operation skipped:" << failureMessageBase;
+void MtpViewModel::runAsyncOperation(std::function<bool()> operation, const QString& successMessage, const QString& failureMessageBase,
+                                     std::function<bool()> onSuccess) {
+    if (!tryBeginOperation()) {
+        qCDebug(lcMtpViewModel) << "ViewModel is busy, operation skipped:" << failureMessageBase;
         emit operationFailed(QString("Operation skipped: Another operation is in progress. (%1)").arg(failureMessageBase));
         return;
     }
-    setBusy(true);
 
     QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
-    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, successMessage, failureMessageBase]() {
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, successMessage, failureMessageBase, onSuccess]() {
         bool result = watcher->result();
         if (result) {
-            qDebug() << successMessage;
-            refreshFileListOnly();
+            qCDebug(lcMtpViewModel) << successMessage;
+            // The rollup already holds the change, so the tree is rebuilt
+            // from it instead of listing the device again; only a change it
+            // couldn't take costs a full listing.
+            if (onSuccess && onSuccess()) {
+                emit directoryStatsUpdated();
+                emit fileListUpdated(m_rollup.paths());
+                setBusy(false);
+            } else {
+                refreshFileListOnly();
+            }
         } else {
-            qWarning() << "Operation failed:" << failureMessageBase;
+            qCWarning(lcMtpViewModel) << "Operation failed:" << failureMessageBase;
             emit operationFailed(failureMessageBase);
             setBusy(false);
         }
         watcher->deleteLater();
     });
 
-    QFuture<bool> future = QtConcurrent::run(operation);
+    const qint64 queuedAt = MtpTrace::isEnabled() ? MtpTrace::nowNs() : 0;
+    QFuture<bool> future = QtConcurrent::run([operation, queuedAt]() {
+        traceQueueWait(queuedAt);
+        MTP_TRACE_SPAN("vm.operation", "viewmodel");
+        return operation();
+    });
     watcher->setFuture(future);
 }
 
 void MtpViewModel::refreshFileListOnly() {
     // if (m_isBusy) {
-    //     qDebug() << "ViewModel is busy, refresh skipped.";
+    //     qCDebug(lcMtpViewModel) << "ViewModel is busy, refresh skipped.";
     //     emit operationFailed("Operation skipped: Another operation is in progress.");
     //     return;
     // }
     setBusy(true);
-    qDebug() << "Refreshing file list only...";
+    qCDebug(lcMtpViewModel) << "Refreshing file list only...";
 
-    QFutureWatcher<QStringList> *watcher = new QFutureWatcher<QStringList>(this);
-    connect(watcher, &QFutureWatcher<QStringList>::finished, this, [this, watcher]() {
-        QStringList fileList = watcher->result();
-        emit fileListUpdated(fileList);
+    QFutureWatcher<RefreshSnapshot> *watcher = new QFutureWatcher<RefreshSnapshot>(this);
+    connect(watcher, &QFutureWatcher<RefreshSnapshot>::finished, this, [this, watcher]() {
+        RefreshSnapshot snapshot = watcher->result();
+        m_rollup = std::move(snapshot.rollup);
+        emit directoryStatsUpdated();
+        emit fileListUpdated(snapshot.files);
         setBusy(false);
         watcher->deleteLater();
     });
 
-    QFuture<QStringList> future = QtConcurrent::run([this]() {
-        return m_device->getFileList();
+    const qint64 queuedAt = MtpTrace::isEnabled() ? MtpTrace::nowNs() : 0;
+    QFuture<RefreshSnapshot> future = QtConcurrent::run([this, queuedAt]() {
+        traceQueueWait(queuedAt);
+        MTP_TRACE_SPAN("vm.refreshFileList", "viewmodel");
+        RefreshSnapshot snapshot;
+        listInto(m_device, snapshot);
+        return snapshot;
     });
     watcher->setFuture(future);
 }
 
 
 void MtpViewModel::readFile(const QString &path) {
-    if (m_isBusy) {
-        qDebug() << "ViewModel is busy, readFile skipped:" << path;
+    if (!tryBeginOperation()) {
+        qCDebug(lcMtpViewModel) << "ViewModel is busy, readFile skipped:" << path;
         emit operationFailed(QString("Operation skipped: Another operation is in progress. (Read %1)").arg(path));
         return;
     }
-    setBusy(true);
 
     QFutureWatcher<QByteArray> *watcher = new QFutureWatcher<QByteArray>(this);
     connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [this, watcher, path]() {
         QByteArray data = watcher->result();
         if (!data.isNull()) {
-            qDebug() << "File read successfully:" << path;
+            qCDebug(lcMtpViewModel) << "File read successfully:" << path;
             emit fileRead(data);
         } else {
-            qWarning() << "Failed to read file:" << path;
+            qCWarning(lcMtpViewModel) << "Failed to read file:" << path;
             emit operationFailed("Failed to read file: " + path);
         }
         setBusy(false);
         watcher->deleteLater();
     });
 
-    QFuture<QByteArray> future = QtConcurrent::run([this, path]() -> QByteArray {
+    const qint64 queuedAt = MtpTrace::isEnabled() ? MtpTrace::nowNs() : 0;
+    QFuture<QByteArray> future = QtConcurrent::run([this, path, queuedAt]() -> QByteArray {
+        traceQueueWait(queuedAt);
+        MTP_TRACE_SPAN("vm.readFile", "viewmodel");
         QByteArray fileData;
         if (m_device->readFile(path, fileData)) {
             return fileData;
@@ -154,33 +239,82 @@ void MtpViewModel::readFile(const QString &path) {
 }
 
 void MtpViewModel::writeFile(const QString &path, const QByteArray &data) {
+    // The stat runs on the worker right after the write, so the rollup gets
+    // the size and mtime the device recorded rather than our own clock.
+    // Without a stat the device is listed again instead.
+    auto written = std::make_shared<WrittenFile>();
     runAsyncOperation(
-        [this, path, data]() { return m_device->writeFile(path, data); },
+        [this, path, data, written]() {
+            if (!m_device->writeFile(path, data))
+                return false;
+            written->stated = m_device->statFile(path, written->info);
+            return true;
+        },
         "File written successfully: " + path,
-        "Failed to write file: " + path
-        );
+        "Failed to write file: " + path,
+        [this, path, written]() {
+            if (!written->stated)
+                return false;
+            const QDateTime &modified = written->info.modified;
+            m_rollup.addFile(path, written->info.size, modified.isValid() ? modified.toSecsSinceEpoch() : 0);
+            return true;
+        });
 }
 
 void MtpViewModel::deleteFile(const QString &path) {
     runAsyncOperation(
         [this, path]() { return m_device->deleteFile(path); },
         "File deleted successfully: " + path,
-        "Failed to delete file: " + path
-        );
+        "Failed to delete file: " + path,
+        [this, path]() { return m_rollup.removeFile(path); });
 }
 
 void MtpViewModel::createDirectory(const QString &path) {
     runAsyncOperation(
         [this, path]() { return m_device->createDirectory(path); },
         "Directory created successfully: " + path,
-        "Failed to create directory: " + path
-        );
+        "Failed to create directory: " + path,
+        [this, path]() { m_rollup.addDirectory(path); return true; });
 }
 
 void MtpViewModel::deleteDirectory(const QString &path) {
     runAsyncOperation(
         [this, path]() { return m_device->deleteDirectory(path); },
         "Directory deleted successfully: " + path,
-        "Failed to delete directory: " + path
-        );
+        "Failed to delete directory: " + path,
+        [this, path]() { return m_rollup.removeDirectory(path); });
+}
+
+void MtpViewModel::exportTree(const QString &devicePath, const QString &localDir) {
+    if (!tryBeginOperation()) {
+        qCDebug(lcMtpViewModel) << "ViewModel is busy, export skipped:" << devicePath;
+        emit operationFailed(QString("Operation skipped: Another operation is in progress. (Export %1)").arg(devicePath));
+        return;
+    }
+
+    QFutureWatcher<MtpExportResult> *watcher = new QFutureWatcher<MtpExportResult>(this);
+    connect(watcher, &QFutureWatcher<MtpExportResult>::finished, this, [this, watcher, devicePath]() {
+        MtpExportResult result = watcher->result();
+        if (result.filesFailed > 0) {
+            qCWarning(lcMtpViewModel) << "Export finished with failures:" << result.failedPaths;
+            emit operationFailed(QString("Failed to export %1 of %2 files from %3")
+                                     .arg(result.filesFailed)
+                                     .arg(result.filesFailed + result.filesCopied)
+                                     .arg(devicePath));
+        }
+        emit exportFinished(result.filesCopied, result.filesFailed, result.bytesCopied);
+        setBusy(false);
+        watcher->deleteLater();
+    });
+
+    const qint64 queuedAt = MtpTrace::isEnabled() ? MtpTrace::nowNs() : 0;
+    QFuture<MtpExportResult> future = QtConcurrent::run([this, devicePath, localDir, queuedAt]() {
+        traceQueueWait(queuedAt);
+        MTP_TRACE_SPAN("vm.exportTree", "viewmodel");
+        MtpExporter exporter(m_device);
+        return exporter.exportTree(devicePath, localDir, [this](int filesDone, int filesTotal, quint64 bytesDone) {
+            emit exportProgress(filesDone, filesTotal, bytesDone);
+        });
+    });
+    watcher->setFuture(future);
 }
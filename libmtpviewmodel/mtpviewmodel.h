@@ -4,8 +4,10 @@
 #include <QObject>
 #include <QStringList>
 #include <QByteArray>
+#include <atomic>
 #include <functional>
 #include "imtdevice.h"
+#include "mtpdirectoryrollup.h"
 
 class MtpViewModel : public QObject {
     Q_OBJECT
@@ -15,11 +17,17 @@ public:
     explicit MtpViewModel(IMtpDevice *device, QObject *parent = nullptr);
     ~MtpViewModel();
 
+    // As of the last refreshDevice(); they don't touch the device.
     QString deviceInfo() const;
     QString freeSpace() const;
     QStringList fileList();
     QStringList fileList(const QString &path);
 
+    // Totals from the last refresh, kept current across writes and deletes
+    // made through this view model. GUI thread only.
+    MtpDirectoryStats directoryStats(const QString &path) const { return m_rollup.stats(path); }
+    QVector<MtpFolderUsage> largestFolders(int count) const { return m_rollup.largestFolders(count); }
+    const MtpDirectoryRollup &directoryRollup() const { return m_rollup; }
 
     bool isBusy() const { return m_isBusy; }
 
@@ -30,20 +38,31 @@ public slots:
     void deleteFile(const QString &path);
     void createDirectory(const QString &path);
     void deleteDirectory(const QString &path);
+    void exportTree(const QString &devicePath, const QString &localDir);
 signals:
     void deviceUpdated();
     void fileListUpdated(const QStringList &files);
+    void directoryStatsUpdated();
     void fileRead(const QByteArray &data);
     void operationFailed(const QString &error);
     void busyChanged(bool busy);
+    void exportProgress(int filesDone, int filesTotal, quint64 bytesDone);
+    void exportFinished(int filesCopied, int filesFailed, quint64 bytesCopied);
 
 private:
-    void runAsyncOperation(std::function<bool()> operation, const QString& successMessage, const QString& failureMessageBase);
+    // onSuccess applies the change to the rollup on the GUI thread; when it
+    // returns false the device is listed again instead.
+    void runAsyncOperation(std::function<bool()> operation, const QString& successMessage, const QString& failureMessageBase,
+                           std::function<bool()> onSuccess = nullptr);
     void refreshFileListOnly();
+    bool tryBeginOperation();
     void setBusy(bool busy);
 
     IMtpDevice *m_device;
-    bool m_isBusy;
+    std::atomic<bool> m_isBusy;
+    QString m_deviceInfo;
+    QString m_freeSpace;
+    MtpDirectoryRollup m_rollup;
 };
 
 #endif // MTPVIEWMODEL_H
@@ -0,0 +1,181 @@
+#include "recordingmtpdevice.h"
+#include <QDebug>
+
+RecordingMtpDevice::RecordingMtpDevice(IMtpDevice *device, const QString &traceFile, ContentMode mode)
+    : m_device(device)
+    , m_mode(mode)
+    , m_file(traceFile)
+{
+    m_clock.start();
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "RecordingMtpDevice: cannot open trace file" << traceFile;
+        return;
+    }
+    m_stream.setDevice(&m_file);
+    MtpSessionTrace::writeHeader(m_stream, m_mode == StoreContent);
+}
+
+RecordingMtpDevice::~RecordingMtpDevice() {
+    QMutexLocker locker(&m_mutex);
+    m_file.close();
+}
+
+MtpSessionRecord RecordingMtpDevice::begin(MtpSessionOp op, const QString &path) {
+    MtpSessionRecord record;
+    record.op = op;
+    record.path = path;
+    record.startUs = m_clock.nsecsElapsed() / 1000;
+    return record;
+}
+
+// Called right after the device call returns, so the digest and the write
+// below don't count towards the recorded latency.
+void RecordingMtpDevice::end(MtpSessionRecord &record) {
+    record.durationUs = m_clock.nsecsElapsed() / 1000 - record.startUs;
+}
+
+void RecordingMtpDevice::finish(MtpSessionRecord &record) {
+    QMutexLocker locker(&m_mutex);
+    if (m_file.isOpen())
+        MtpSessionTrace::writeRecord(m_stream, record);
+}
+
+void RecordingMtpDevice::setContent(MtpSessionRecord &record, const QByteArray &data, bool keep) {
+    record.value = static_cast<quint64>(data.size());
+    record.digest = MtpSessionTrace::digest(data);
+    if (keep && m_mode == StoreContent)
+        record.content = data;
+}
+
+QVector<MtpDeviceInfo> RecordingMtpDevice::detectDevices() {
+    MtpSessionRecord record = begin(MtpSessionOp::DetectDevices);
+    QVector<MtpDeviceInfo> devices = m_device->detectDevices();
+    end(record);
+    record.ok = true;
+    record.devices = devices;
+    finish(record);
+    return devices;
+}
+
+QString RecordingMtpDevice::getDeviceVersion() {
+    MtpSessionRecord record = begin(MtpSessionOp::GetDeviceVersion);
+    record.text = m_device->getDeviceVersion();
+    end(record);
+    record.ok = true;
+    finish(record);
+    return record.text;
+}
+
+QString RecordingMtpDevice::getDeviceInfo() {
+    MtpSessionRecord record = begin(MtpSessionOp::GetDeviceInfo);
+    record.text = m_device->getDeviceInfo();
+    end(record);
+    record.ok = true;
+    finish(record);
+    return record.text;
+}
+
+quint64 RecordingMtpDevice::getFreeSpace() {
+    MtpSessionRecord record = begin(MtpSessionOp::GetFreeSpace);
+    record.value = m_device->getFreeSpace();
+    end(record);
+    record.ok = true;
+    finish(record);
+    return record.value;
+}
+
+QStringList RecordingMtpDevice::getFileList(const QString &path) {
+    MtpSessionRecord record = begin(MtpSessionOp::GetFileList, path);
+    record.list = m_device->getFileList(path);
+    end(record);
+    record.ok = true;
+    finish(record);
+    return record.list;
+}
+
+QVector<MtpFileInfo> RecordingMtpDevice::getFileInfoList(const QString &path) {
+    MtpSessionRecord record = begin(MtpSessionOp::GetFileInfoList, path);
+    record.infos = m_device->getFileInfoList(path);
+    end(record);
+    record.ok = true;
+    finish(record);
+    return record.infos;
+}
+
+bool RecordingMtpDevice::statFile(const QString &path, MtpFileInfo &info) {
+    MtpSessionRecord record = begin(MtpSessionOp::StatFile, path);
+    record.ok = m_device->statFile(path, info);
+    end(record);
+    if (record.ok)
+        record.info = info;
+    finish(record);
+    return record.ok;
+}
+
+bool RecordingMtpDevice::readFile(const QString &path, QByteArray &data) {
+    MtpSessionRecord record = begin(MtpSessionOp::ReadFile, path);
+    record.ok = m_device->readFile(path, data);
+    end(record);
+    if (record.ok)
+        setContent(record, data, true);
+    finish(record);
+    return record.ok;
+}
+
+bool RecordingMtpDevice::readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) {
+    MtpSessionRecord record = begin(MtpSessionOp::ReadRange, path);
+    record.offset = offset;
+    record.length = length;
+    record.ok = m_device->readRange(path, offset, length, data);
+    end(record);
+    if (record.ok)
+        setContent(record, data, true);
+    finish(record);
+    return record.ok;
+}
+
+// Recorded as a plain ReadRange so traces replay on any backend.
+bool RecordingMtpDevice::readObjectRange(const MtpFileInfo &object, quint64 offset, quint64 length, QByteArray &data) {
+    MtpSessionRecord record = begin(MtpSessionOp::ReadRange, object.path);
+    record.offset = offset;
+    record.length = length;
+    record.ok = m_device->readObjectRange(object, offset, length, data);
+    end(record);
+    if (record.ok)
+        setContent(record, data, true);
+    finish(record);
+    return record.ok;
+}
+
+bool RecordingMtpDevice::writeFile(const QString &path, const QByteArray &data) {
+    MtpSessionRecord record = begin(MtpSessionOp::WriteFile, path);
+    record.ok = m_device->writeFile(path, data);
+    end(record);
+    setContent(record, data, false);
+    finish(record);
+    return record.ok;
+}
+
+bool RecordingMtpDevice::deleteFile(const QString &path) {
+    MtpSessionRecord record = begin(MtpSessionOp::DeleteFile, path);
+    record.ok = m_device->deleteFile(path);
+    end(record);
+    finish(record);
+    return record.ok;
+}
+
+bool RecordingMtpDevice::createDirectory(const QString &path) {
+    MtpSessionRecord record = begin(MtpSessionOp::CreateDirectory, path);
+    record.ok = m_device->createDirectory(path);
+    end(record);
+    finish(record);
+    return record.ok;
+}
+
+bool RecordingMtpDevice::deleteDirectory(const QString &path) {
+    MtpSessionRecord record = begin(MtpSessionOp::DeleteDirectory, path);
+    record.ok = m_device->deleteDirectory(path);
+    end(record);
+    finish(record);
+    return record.ok;
+}
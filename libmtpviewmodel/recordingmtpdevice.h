@@ -0,0 +1,55 @@
+#ifndef RECORDINGMTPDEVICE_H
+#define RECORDINGMTPDEVICE_H
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include "imtdevice.h"
+#include "mtpsessiontrace.h"
+
+// Passes every call through to another IMtpDevice and appends it, with its
+// arguments, result metadata and timing, to a session trace that
+// ReplayMtpDevice can serve later.
+class RecordingMtpDevice : public IMtpDevice {
+public:
+    enum ContentMode {
+        HashContent,  // keep size and digest of transferred data only
+        StoreContent  // keep read data too, so replay returns the real bytes
+    };
+
+    RecordingMtpDevice(IMtpDevice *device, const QString &traceFile, ContentMode mode = HashContent);
+    ~RecordingMtpDevice() override;
+
+    bool isRecording() const { return m_file.isOpen(); }
+
+    QVector<MtpDeviceInfo> detectDevices() override;
+    QString getDeviceVersion() override;
+    QString getDeviceInfo() override;
+    quint64 getFreeSpace() override;
+    QStringList getFileList(const QString &path = "/") override;
+    QVector<MtpFileInfo> getFileInfoList(const QString &path = "/") override;
+    bool statFile(const QString &path, MtpFileInfo &info) override;
+    bool readFile(const QString &path, QByteArray &data) override;
+    bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) override;
+    bool readObjectRange(const MtpFileInfo &object, quint64 offset, quint64 length, QByteArray &data) override;
+    bool writeFile(const QString &path, const QByteArray &data) override;
+    bool deleteFile(const QString &path) override;
+    bool createDirectory(const QString &path) override;
+    bool deleteDirectory(const QString &path) override;
+
+private:
+    MtpSessionRecord begin(MtpSessionOp op, const QString &path = QString());
+    void end(MtpSessionRecord &record);
+    void finish(MtpSessionRecord &record);
+    void setContent(MtpSessionRecord &record, const QByteArray &data, bool keep);
+
+    IMtpDevice *m_device;
+    ContentMode m_mode;
+    QElapsedTimer m_clock;
+    QMutex m_mutex;
+    QFile m_file;
+    QDataStream m_stream;
+};
+
+#endif // RECORDINGMTPDEVICE_H
@@ -0,0 +1,169 @@
+#include "replaymtpdevice.h"
+#include <QDataStream>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QThread>
+#include <cstring>
+
+Q_LOGGING_CATEGORY(lcMtpReplay, "mtp.replay", QtWarningMsg)
+
+ReplayMtpDevice::ReplayMtpDevice(const QString &traceFile, double timeScale)
+    : m_timeScale(qMax(0.0, timeScale))
+    , m_valid(false)
+    , m_unmatched(0)
+{
+    QFile file(traceFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(lcMtpReplay) << "cannot open trace file" << traceFile;
+        return;
+    }
+
+    QDataStream in(&file);
+    bool storesContent = false;
+    if (!MtpSessionTrace::readHeader(in, storesContent)) {
+        qCWarning(lcMtpReplay) << "not a session trace:" << traceFile;
+        return;
+    }
+
+    MtpSessionRecord record;
+    while (!in.atEnd() && MtpSessionTrace::readRecord(in, record)) {
+        m_pending[keyFor(record.op, record.path, record.offset, record.length)].enqueue(m_records.size());
+        m_records.append(record);
+    }
+    if (!in.atEnd())
+        qCWarning(lcMtpReplay) << "trace truncated after" << m_records.size() << "records";
+
+    m_valid = true;
+}
+
+int ReplayMtpDevice::unmatchedCalls() const {
+    QMutexLocker locker(&m_mutex);
+    return m_unmatched;
+}
+
+QString ReplayMtpDevice::keyFor(MtpSessionOp op, const QString &path, quint64 offset, quint64 length) {
+    return QString("%1|%2|%3|%4").arg(int(op)).arg(path).arg(offset).arg(length);
+}
+
+const MtpSessionRecord *ReplayMtpDevice::take(MtpSessionOp op, const QString &path, quint64 offset, quint64 length) {
+    const QString key = keyFor(op, path, offset, length);
+    const MtpSessionRecord *record = nullptr;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto pending = m_pending.find(key);
+        if (pending != m_pending.end() && !pending->isEmpty()) {
+            int index = pending->dequeue();
+            m_lastServed.insert(key, index);
+            record = &m_records.at(index);
+        } else if (m_lastServed.contains(key)) {
+            record = &m_records.at(m_lastServed.value(key));
+        } else {
+            ++m_unmatched;
+        }
+    }
+
+    if (!record) {
+        qCWarning(lcMtpReplay) << "no recorded call for" << key;
+        return nullptr;
+    }
+    if (m_timeScale > 0.0 && record->durationUs > 0)
+        QThread::usleep(static_cast<unsigned long>(record->durationUs * m_timeScale));
+    return record;
+}
+
+QByteArray ReplayMtpDevice::contentOf(const MtpSessionRecord &record) const {
+    if (!record.content.isEmpty() || record.value == 0)
+        return record.content;
+
+    // Hash-only trace: fill the recorded size with the digest so the payload
+    // is deterministic without having been stored.
+    // The copy doubles each round, so this is a handful of memcpy calls
+    // even for large objects.
+    QByteArray data(static_cast<qsizetype>(record.value), Qt::Uninitialized);
+    const QByteArray pattern = record.digest.isEmpty() ? QByteArray(1, '\0') : record.digest;
+    char *out = data.data();
+    const qsizetype total = data.size();
+    qsizetype filled = qMin(pattern.size(), total);
+    memcpy(out, pattern.constData(), size_t(filled));
+    while (filled < total) {
+        const qsizetype chunk = qMin(filled, total - filled);
+        memcpy(out + filled, out, size_t(chunk));
+        filled += chunk;
+    }
+    return data;
+}
+
+QVector<MtpDeviceInfo> ReplayMtpDevice::detectDevices() {
+    const MtpSessionRecord *record = take(MtpSessionOp::DetectDevices, QString());
+    return record ? record->devices : QVector<MtpDeviceInfo>();
+}
+
+QString ReplayMtpDevice::getDeviceVersion() {
+    const MtpSessionRecord *record = take(MtpSessionOp::GetDeviceVersion, QString());
+    return record ? record->text : QString("Error: Could not open device");
+}
+
+QString ReplayMtpDevice::getDeviceInfo() {
+    const MtpSessionRecord *record = take(MtpSessionOp::GetDeviceInfo, QString());
+    return record ? record->text : QString("Error: Could not open device");
+}
+
+quint64 ReplayMtpDevice::getFreeSpace() {
+    const MtpSessionRecord *record = take(MtpSessionOp::GetFreeSpace, QString());
+    return record ? record->value : 0;
+}
+
+QStringList ReplayMtpDevice::getFileList(const QString &path) {
+    const MtpSessionRecord *record = take(MtpSessionOp::GetFileList, path);
+    return record ? record->list : QStringList();
+}
+
+QVector<MtpFileInfo> ReplayMtpDevice::getFileInfoList(const QString &path) {
+    const MtpSessionRecord *record = take(MtpSessionOp::GetFileInfoList, path);
+    return record ? record->infos : QVector<MtpFileInfo>();
+}
+
+bool ReplayMtpDevice::statFile(const QString &path, MtpFileInfo &info) {
+    const MtpSessionRecord *record = take(MtpSessionOp::StatFile, path);
+    if (!record || !record->ok)
+        return false;
+    info = record->info;
+    return true;
+}
+
+bool ReplayMtpDevice::readFile(const QString &path, QByteArray &data) {
+    const MtpSessionRecord *record = take(MtpSessionOp::ReadFile, path);
+    if (!record || !record->ok)
+        return false;
+    data = contentOf(*record);
+    return true;
+}
+
+bool ReplayMtpDevice::readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) {
+    const MtpSessionRecord *record = take(MtpSessionOp::ReadRange, path, offset, length);
+    if (!record || !record->ok)
+        return false;
+    data = contentOf(*record);
+    return true;
+}
+
+bool ReplayMtpDevice::writeFile(const QString &path, const QByteArray &data) {
+    Q_UNUSED(data);
+    const MtpSessionRecord *record = take(MtpSessionOp::WriteFile, path);
+    return record && record->ok;
+}
+
+bool ReplayMtpDevice::deleteFile(const QString &path) {
+    const MtpSessionRecord *record = take(MtpSessionOp::DeleteFile, path);
+    return record && record->ok;
+}
+
+bool ReplayMtpDevice::createDirectory(const QString &path) {
+    const MtpSessionRecord *record = take(MtpSessionOp::CreateDirectory, path);
+    return record && record->ok;
+}
+
+bool ReplayMtpDevice::deleteDirectory(const QString &path) {
+    const MtpSessionRecord *record = take(MtpSessionOp::DeleteDirectory, path);
+    return record && record->ok;
+}
@@ -0,0 +1,55 @@
+#ifndef REPLAYMTPDEVICE_H
+#define REPLAYMTPDEVICE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QVector>
+#include "imtdevice.h"
+#include "mtpsessiontrace.h"
+
+// IMtpDevice backend that serves a session recorded by RecordingMtpDevice.
+// Each call is answered by the next unused record with the same operation
+// and arguments, after sleeping for the recorded duration scaled by
+// timeScale (0 replays as fast as possible). Once a call's records are used
+// up the last one is served again, so looping benchmarks keep working.
+// Reads from hash-only traces return deterministic filler of the recorded
+// size.
+class ReplayMtpDevice : public IMtpDevice {
+public:
+    explicit ReplayMtpDevice(const QString &traceFile, double timeScale = 1.0);
+
+    bool isValid() const { return m_valid; }
+    int recordCount() const { return m_records.size(); }
+    int unmatchedCalls() const;
+
+    QVector<MtpDeviceInfo> detectDevices() override;
+    QString getDeviceVersion() override;
+    QString getDeviceInfo() override;
+    quint64 getFreeSpace() override;
+    QStringList getFileList(const QString &path = "/") override;
+    QVector<MtpFileInfo> getFileInfoList(const QString &path = "/") override;
+    bool statFile(const QString &path, MtpFileInfo &info) override;
+    bool readFile(const QString &path, QByteArray &data) override;
+    bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) override;
+    bool writeFile(const QString &path, const QByteArray &data) override;
+    bool deleteFile(const QString &path) override;
+    bool createDirectory(const QString &path) override;
+    bool deleteDirectory(const QString &path) override;
+
+private:
+    static QString keyFor(MtpSessionOp op, const QString &path, quint64 offset = 0, quint64 length = 0);
+    const MtpSessionRecord *take(MtpSessionOp op, const QString &path, quint64 offset = 0, quint64 length = 0);
+    QByteArray contentOf(const MtpSessionRecord &record) const;
+
+    QVector<MtpSessionRecord> m_records;
+    double m_timeScale;
+    bool m_valid;
+
+    mutable QMutex m_mutex;
+    QHash<QString, QQueue<int>> m_pending;
+    QHash<QString, int> m_lastServed;
+    int m_unmatched;
+};
+
+#endif // REPLAYMTPDEVICE_H
@@ -5,11 +5,14 @@
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QHash>
 
 class StubMtpDevice : public IMtpDevice {
 public:
-    StubMtpDevice() {
-        QDir().mkpath("/tmp/mtp_sim");
+    explicit StubMtpDevice(const QString &rootPath = "/tmp/mtp_sim")
+        : m_rootPath(rootPath)
+    {
+        QDir().mkpath(m_rootPath);
     }
 
     QVector<MtpDeviceInfo> detectDevices() override {
@@ -22,7 +25,7 @@ public:
     }
 
     QStringList getFileList(const QString &path = "/") override {
-        QString basePath = "/tmp/mtp_sim";
+        QString basePath = m_rootPath;
         QString relPath = path;
         if (relPath.startsWith("/")) relPath = relPath.mid(1);
         QString fullPath = basePath + (relPath.isEmpty() ? "" : "/" + relPath);
@@ -42,6 +45,36 @@ public:
         return result;
     }
 
+    QVector<MtpFileInfo> getFileInfoList(const QString &path = "/") override {
+        QVector<MtpFileInfo> result;
+        QDir dir(makeFullPath(path));
+        const QFileInfoList entries = dir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries);
+        for (const QFileInfo &fi : entries) {
+            MtpFileInfo info;
+            info.path = (path.endsWith("/") ? path : path + "/") + fi.fileName() + (fi.isDir() ? "/" : "");
+            info.objectId = static_cast<quint32>(qHash(fi.absoluteFilePath()));
+            info.size = fi.isDir() ? 0 : static_cast<quint64>(fi.size());
+            info.modified = fi.lastModified();
+            info.isDir = fi.isDir();
+            result << info;
+            if (info.isDir)
+                result << getFileInfoList(info.path);
+        }
+        return result;
+    }
+
+    bool statFile(const QString &path, MtpFileInfo &info) override {
+        QFileInfo fi(makeFullPath(path));
+        if (!fi.exists())
+            return false;
+        info.path = path;
+        info.objectId = static_cast<quint32>(qHash(fi.absoluteFilePath()));
+        info.size = fi.isDir() ? 0 : static_cast<quint64>(fi.size());
+        info.modified = fi.lastModified();
+        info.isDir = fi.isDir();
+        return true;
+    }
+
     bool readFile(const QString &path, QByteArray &data) override {
         QString fullPath = makeFullPath(path);
         QFile file(fullPath);
@@ -51,6 +84,20 @@ public:
         return true;
     }
 
+    bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) override {
+        QFile file(makeFullPath(path));
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        if (offset >= static_cast<quint64>(file.size())) {
+            data.clear();
+            return true;
+        }
+        if (!file.seek(static_cast<qint64>(offset)))
+            return false;
+        data = file.read(static_cast<qint64>(qMin<quint64>(length, file.size() - offset)));
+        return true;
+    }
+
     bool writeFile(const QString &path, const QByteArray &data) override {
         QString fullPath = makeFullPath(path);
         QDir().mkpath(QFileInfo(fullPath).absolutePath());
@@ -80,11 +127,13 @@ public:
 
 private:
     QString makeFullPath(const QString &path) const {
-        QString basePath = "/tmp/mtp_sim";
+        QString basePath = m_rootPath;
         QString relPath = path;
         if (relPath.startsWith("/")) relPath = relPath.mid(1);
         return basePath + (relPath.isEmpty() ? "" : "/" + relPath);
     }
+
+    QString m_rootPath;
 };
 
 #endif // STUBMTPDEVICE_H
@@ -0,0 +1,82 @@
+#ifndef TRACINGMTPDEVICE_H
+#define TRACINGMTPDEVICE_H
+
+#include "imtdevice.h"
+#include "mtptrace.h"
+
+// Wraps every IMtpDevice call in an MtpTraceSpan. Costs one atomic load per
+// call while tracing is disabled.
+class TracingMtpDevice : public IMtpDevice {
+public:
+    explicit TracingMtpDevice(IMtpDevice *device) : m_device(device) {}
+
+    QVector<MtpDeviceInfo> detectDevices() override {
+        MTP_TRACE_SPAN("device.detectDevices", "device");
+        return m_device->detectDevices();
+    }
+    QString getDeviceVersion() override {
+        MTP_TRACE_SPAN("device.getDeviceVersion", "device");
+        return m_device->getDeviceVersion();
+    }
+    QString getDeviceInfo() override {
+        MTP_TRACE_SPAN("device.getDeviceInfo", "device");
+        return m_device->getDeviceInfo();
+    }
+    quint64 getFreeSpace() override {
+        MTP_TRACE_SPAN("device.getFreeSpace", "device");
+        return m_device->getFreeSpace();
+    }
+    QStringList getFileList(const QString &path = "/") override {
+        MTP_TRACE_SPAN("device.getFileList", "device");
+        return m_device->getFileList(path);
+    }
+    QVector<MtpFileInfo> getFileInfoList(const QString &path = "/") override {
+        MTP_TRACE_SPAN("device.getFileInfoList", "device");
+        return m_device->getFileInfoList(path);
+    }
+    bool statFile(const QString &path, MtpFileInfo &info) override {
+        MTP_TRACE_SPAN("device.statFile", "device");
+        return m_device->statFile(path, info);
+    }
+    bool readFile(const QString &path, QByteArray &data) override {
+        MtpTraceSpan span("device.readFile", "device");
+        bool ok = m_device->readFile(path, data);
+        span.addBytes(ok ? data.size() : 0);
+        return ok;
+    }
+    bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) override {
+        MtpTraceSpan span("device.readRange", "device");
+        bool ok = m_device->readRange(path, offset, length, data);
+        span.addBytes(ok ? data.size() : 0);
+        return ok;
+    }
+    bool readObjectRange(const MtpFileInfo &object, quint64 offset, quint64 length, QByteArray &data) override {
+        MtpTraceSpan span("device.readObjectRange", "device");
+        bool ok = m_device->readObjectRange(object, offset, length, data);
+        span.addBytes(ok ? data.size() : 0);
+        return ok;
+    }
+    bool writeFile(const QString &path, const QByteArray &data) override {
+        MtpTraceSpan span("device.writeFile", "device");
+        bool ok = m_device->writeFile(path, data);
+        span.addBytes(ok ? data.size() : 0);
+        return ok;
+    }
+    bool deleteFile(const QString &path) override {
+        MTP_TRACE_SPAN("device.deleteFile", "device");
+        return m_device->deleteFile(path);
+    }
+    bool createDirectory(const QString &path) override {
+        MTP_TRACE_SPAN("device.createDirectory", "device");
+        return m_device->createDirectory(path);
+    }
+    bool deleteDirectory(const QString &path) override {
+        MTP_TRACE_SPAN("device.deleteDirectory", "device");
+        return m_device->deleteDirectory(path);
+    }
+
+private:
+    IMtpDevice *m_device;
+};
+
+#endif // TRACINGMTPDEVICE_H
@@ -0,0 +1,145 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QTextStream>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include "cachingmtpdevice.h"
+#include "mtpbackend.h"
+#include "mtptrace.h"
+#include "mtpviewmodel.h"
+#include "reconnectcheck.h"
+#include "soakrunner.h"
+#include "tracingmtpdevice.h"
+
+namespace {
+
+bool parseMix(const QString &text, SoakOptions &options, QString &error) {
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts)) {
+        const QStringList parts = item.split('=');
+        const SoakOp op = parts.size() == 2 ? SoakRunner::opFromName(parts[0].trimmed()) : SoakOp::Count;
+        bool ok = false;
+        const int weight = parts.size() == 2 ? parts[1].toInt(&ok) : 0;
+        if (op == SoakOp::Count || op > SoakOp::ViewModel || !ok || weight < 0) {
+            error = "bad --mix entry " + item;
+            return false;
+        }
+        options.mix[int(op)] = weight;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("mtp_soak");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Concurrent load test for MtpViewModel and the IMtpDevice backends.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {{"d", "device"}, "Backend: stub[:root] (default), mtp[:<bus>:<devnum>|:serial=<serial>] or replay:<trace>.", "spec", "stub"},
+        {{"t", "duration"}, "Run time in seconds (default 30).", "seconds", "30"},
+        {{"j", "threads"}, "Worker threads (default 4).", "n", "4"},
+        {"seed", "Random seed (default 1).", "n", "1"},
+        {"files", "Files per worker directory (default 32).", "n", "32"},
+        {"max-size", "Largest file written, in bytes (default 262144).", "bytes", "262144"},
+        {"mix", "Operation weights, e.g. read=30,write=20,viewModel=3. Ops: read, readRange, write, delete, list, stat, mkdir, rmdir, viewModel.", "weights"},
+        {"cache", "Put a CachingMtpDevice in front of the backend."},
+        {"trace", "Wrap the backend in TracingMtpDevice and write a Chrome trace to <file>.", "file"},
+        {"json", "Print the report as JSON."},
+        {"verbose", "Keep the library's warnings about failed and skipped operations."},
+        {"reconnect-check", "Instead of the load run, pull a file through MtpTransferJob while the device drops out and comes back, and check that it resumes."},
+    });
+    parser.process(app);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    SoakOptions options;
+    options.durationSec = qMax(1, parser.value("duration").toInt());
+    options.threads = qMax(1, parser.value("threads").toInt());
+    options.seed = parser.value("seed").toUInt();
+    options.filesPerThread = qMax(1, parser.value("files").toInt());
+    options.maxFileBytes = qMax(0, parser.value("max-size").toInt());
+    options.mix[int(SoakOp::Read)] = 30;
+    options.mix[int(SoakOp::ReadRange)] = 10;
+    options.mix[int(SoakOp::Write)] = 20;
+    options.mix[int(SoakOp::Delete)] = 8;
+    options.mix[int(SoakOp::List)] = 10;
+    options.mix[int(SoakOp::Stat)] = 15;
+    options.mix[int(SoakOp::Mkdir)] = 2;
+    options.mix[int(SoakOp::Rmdir)] = 2;
+    options.mix[int(SoakOp::ViewModel)] = 3;
+    if (parser.isSet("mix")) {
+        std::fill(std::begin(options.mix), std::end(options.mix), 0);
+        QString error;
+        if (!parseMix(parser.value("mix"), options, error)) {
+            err << "mtp_soak: " << error << "\n";
+            return 2;
+        }
+    }
+    if (std::all_of(std::begin(options.mix), std::end(options.mix), [](int w) { return w == 0; })) {
+        err << "mtp_soak: --mix has no non-zero weight\n";
+        return 2;
+    }
+
+    // Skipped and failed operations are expected under this load and would
+    // otherwise bury the report. Only the library is muted; the runner logs
+    // under "soak".
+    if (!parser.isSet("verbose"))
+        QLoggingCategory::setFilterRules("mtp.*.warning=false");
+
+    QString error;
+    std::vector<std::unique_ptr<IMtpDevice>> owned;
+    // The stub defaults to its own scratch directory so a soak run never
+    // touches the app's simulated device.
+    IMtpDevice *device = createMtpBackend(parser.value("device"), error, QDir::tempPath() + "/mtp_soak");
+    if (!device) {
+        err << "mtp_soak: " << error << "\n";
+        return 2;
+    }
+    owned.emplace_back(device);
+    if (parser.isSet("trace")) {
+        MtpTrace::setEnabled(true);
+        device = new TracingMtpDevice(device);
+        owned.emplace_back(device);
+    }
+    if (parser.isSet("cache")) {
+        device = new CachingMtpDevice(device);
+        owned.emplace_back(device);
+    }
+
+    if (parser.isSet("reconnect-check")) {
+        device->deleteDirectory("/soak/");
+        const bool passed = runReconnectCheck(device, out);
+        device->deleteDirectory("/soak/");
+        return passed ? 0 : 1;
+    }
+
+    device->deleteDirectory("/soak/");
+    device->createDirectory("/soak/shared/");
+    device->createDirectory("/soak/vm/");
+
+    MtpViewModel viewModel(device);
+    SoakRunner runner(device, &viewModel, options);
+    QObject::connect(&runner, &SoakRunner::finished, &app, &QCoreApplication::quit);
+    runner.start();
+    app.exec();
+
+    if (parser.isSet("json"))
+        out << QJsonDocument(runner.report()).toJson(QJsonDocument::Compact) << "\n";
+    else
+        out << runner.textReport();
+
+    if (parser.isSet("trace") && !MtpTrace::writeChromeTrace(parser.value("trace")))
+        err << "mtp_soak: cannot write trace " << parser.value("trace") << "\n";
+
+    device->deleteDirectory("/soak/");
+    return runner.mismatches() > 0 ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+#include "reconnectcheck.h"
+#include "mtptransferjob.h"
+#include <QFile>
+#include <QTemporaryDir>
+#include <atomic>
+
+namespace {
+
+const quint64 kChunkSize = 64 * 1024;
+const char *const kObjectPath = "/soak/reconnect/object.bin";
+
+// Passes calls through while attached and fails them while not. Each
+// reattach shifts the object IDs, and reads by a previous attach's ID fail
+// like a stale handle would.
+class UnpluggableDevice : public IMtpDevice {
+public:
+    explicit UnpluggableDevice(IMtpDevice *device) : m_device(device), m_attached(true), m_epoch(0), m_bytesRead(0) {}
+
+    void unplug() { m_attached = false; }
+    void replug() {
+        ++m_epoch;
+        m_attached = true;
+    }
+    quint64 bytesRead() const { return m_bytesRead; }
+
+    QVector<MtpDeviceInfo> detectDevices() override { return m_attached ? m_device->detectDevices() : QVector<MtpDeviceInfo>(); }
+    QString getDeviceVersion() override { return m_attached ? m_device->getDeviceVersion() : QString(); }
+    QString getDeviceInfo() override { return m_attached ? m_device->getDeviceInfo() : QString(); }
+    quint64 getFreeSpace() override { return m_attached ? m_device->getFreeSpace() : 0; }
+    QStringList getFileList(const QString &path = "/") override { return m_attached ? m_device->getFileList(path) : QStringList(); }
+
+    QVector<MtpFileInfo> getFileInfoList(const QString &path = "/") override {
+        if (!m_attached)
+            return {};
+        QVector<MtpFileInfo> infos = m_device->getFileInfoList(path);
+        for (MtpFileInfo &info : infos)
+            info.objectId = renumbered(info.objectId);
+        return infos;
+    }
+
+    bool statFile(const QString &path, MtpFileInfo &info) override {
+        if (!m_attached || !m_device->statFile(path, info))
+            return false;
+        info.objectId = renumbered(info.objectId);
+        return true;
+    }
+
+    bool readFile(const QString &path, QByteArray &data) override {
+        if (!m_attached || !m_device->readFile(path, data))
+            return false;
+        m_bytesRead += data.size();
+        return true;
+    }
+
+    bool readRange(const QString &path, quint64 offset, quint64 length, QByteArray &data) override {
+        if (!m_attached || !m_device->readRange(path, offset, length, data))
+            return false;
+        m_bytesRead += data.size();
+        return true;
+    }
+
+    bool readObjectRange(const MtpFileInfo &object, quint64 offset, quint64 length, QByteArray &data) override {
+        MtpFileInfo current;
+        if (!statFile(object.path, current) || current.objectId != object.objectId)
+            return false;
+        return readRange(object.path, offset, length, data);
+    }
+
+    bool writeFile(const QString &path, const QByteArray &data) override { return m_attached && m_device->writeFile(path, data); }
+    bool deleteFile(const QString &path) override { return m_attached && m_device->deleteFile(path); }
+    bool createDirectory(const QString &path) override { return m_attached && m_device->createDirectory(path); }
+    bool deleteDirectory(const QString &path) override { return m_attached && m_device->deleteDirectory(path); }
+
+private:
+    quint32 renumbered(quint32 objectId) const { return objectId + m_epoch * 0x10000u; }
+
+    IMtpDevice *m_device;
+    std::atomic<bool> m_attached;
+    std::atomic<quint32> m_epoch;
+    std::atomic<quint64> m_bytesRead;
+};
+
+bool samePulled(const QString &localPath, const QByteArray &expected) {
+    QFile file(localPath);
+    return file.open(QIODevice::ReadOnly) && file.readAll() == expected;
+}
+
+void report(QTextStream &out, const QString &name, bool ok, const QString &detail) {
+    out << "reconnect: " << name << ": " << (ok ? "ok" : "FAILED") << " (" << detail << ")\n";
+}
+
+} // namespace
+
+bool runReconnectCheck(IMtpDevice *device, QTextStream &out) {
+    QTemporaryDir local;
+    QByteArray data(int(8 * kChunkSize + 123), Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = char(i * 31 + (i >> 8));
+    device->createDirectory("/soak/reconnect/");
+    if (!local.isValid() || !device->writeFile(kObjectPath, data)) {
+        out << "reconnect: cannot set up the test object\n";
+        return false;
+    }
+
+    bool passed = true;
+
+    // Back before the retries ran out: the job re-stats, finds the object
+    // under its new ID and carries on within the same run().
+    {
+        UnpluggableDevice flaky(device);
+        MtpTransferJob job(&flaky, local.filePath("bump.journal"), kChunkSize);
+        job.setRetryPolicy(1, 0);
+        job.addPull(kObjectPath, local.filePath("bump.bin"));
+        bool bumped = false;
+        const MtpTransferStatus status = job.run([&](const QString &, quint64 done, quint64) {
+            if (!bumped && done >= 2 * kChunkSize) {
+                bumped = true;
+                flaky.unplug();
+                flaky.replug();
+            }
+        });
+        const bool ok = bumped && status == MtpTransferStatus::Completed && samePulled(local.filePath("bump.bin"), data)
+            && flaky.bytesRead() == quint64(data.size());
+        report(out, "cable bump", ok, QString("%1 of %2 bytes read").arg(flaky.bytesRead()).arg(data.size()));
+        passed = passed && ok;
+    }
+
+    // Gone for longer: run() stops as Interrupted, and a job resumed from
+    // the journal after the device is back picks up at the confirmed offset.
+    {
+        UnpluggableDevice flaky(device);
+        const QString journal = local.filePath("unplug.journal");
+        MtpTransferStatus first = MtpTransferStatus::Completed;
+        {
+            MtpTransferJob job(&flaky, journal, kChunkSize);
+            job.setRetryPolicy(1, 0);
+            job.addPull(kObjectPath, local.filePath("unplug.bin"));
+            first = job.run([&](const QString &, quint64 done, quint64) {
+                if (done >= 2 * kChunkSize)
+                    flaky.unplug();
+            });
+        }
+        flaky.replug();
+
+        MtpTransferJob resumed(&flaky, journal, kChunkSize);
+        resumed.setRetryPolicy(1, 0);
+        const bool loaded = resumed.resume();
+        const MtpTransferStatus second = resumed.run();
+        const bool ok = first == MtpTransferStatus::Interrupted && loaded && second == MtpTransferStatus::Completed
+            && samePulled(local.filePath("unplug.bin"), data) && flaky.bytesRead() == quint64(data.size());
+        report(out, "unplug and resume", ok, QString("%1 of %2 bytes read").arg(flaky.bytesRead()).arg(data.size()));
+        passed = passed && ok;
+    }
+
+    device->deleteDirectory("/soak/reconnect/");
+    return passed;
+}
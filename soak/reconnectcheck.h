@@ -0,0 +1,15 @@
+#ifndef RECONNECTCHECK_H
+#define RECONNECTCHECK_H
+
+#include <QTextStream>
+#include "imtdevice.h"
+
+// Pulls one object through MtpTransferJob while the device drops out mid
+// transfer, once coming straight back (a cable bump within the retries) and
+// once staying away until the job gave up. On the way back the device hands
+// out new object IDs, the way a reconnected phone does. Passes when both
+// pulls finish with the right bytes and no chunk was read twice. Runs on
+// /soak/reconnect/ of device; meant for the stub.
+bool runReconnectCheck(IMtpDevice *device, QTextStream &out);
+
+#endif // RECONNECTCHECK_H
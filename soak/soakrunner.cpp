@@ -0,0 +1,336 @@
+#include "soakrunner.h"
+#include "mtpviewmodel.h"
+#include <QLoggingCategory>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QTimer>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+Q_LOGGING_CATEGORY(lcSoak, "soak")
+
+namespace {
+
+const char *const opNames[int(SoakOp::Count)] = {
+    "read", "readRange", "write", "delete", "list", "stat", "mkdir", "rmdir",
+    "viewModel", "vm.refresh", "vm.read", "vm.write", "vm.delete"
+};
+
+constexpr quint64 RangeLength = 64 * 1024;
+
+QByteArray randomContent(std::mt19937 &rng, int maxBytes) {
+    const int size = std::uniform_int_distribution<int>(0, maxBytes)(rng);
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; i += 4) {
+        const quint32 word = rng();
+        for (int j = 0; j < 4 && i + j < size; ++j)
+            data[i + j] = char(word >> (8 * j));
+    }
+    return data;
+}
+
+// Nearest-rank percentile of sorted samples, in microseconds.
+double percentileUs(const QVector<qint64> &sorted, double p) {
+    if (sorted.isEmpty())
+        return 0.0;
+    const qsizetype rank = qBound<qsizetype>(1, qsizetype(std::ceil(p * sorted.size())), sorted.size());
+    return sorted.at(rank - 1) / 1000.0;
+}
+
+} // namespace
+
+void SoakSamples::merge(const SoakSamples &other) {
+    for (int i = 0; i < int(SoakOp::Count); ++i) {
+        latencyNs[i] += other.latencyNs[i];
+        failures[i] += other.failures[i];
+    }
+}
+
+SoakRunner::SoakRunner(IMtpDevice *device, MtpViewModel *viewModel, const SoakOptions &options, QObject *parent)
+    : QObject(parent)
+    , m_device(device)
+    , m_viewModel(viewModel)
+    , m_options(options)
+    , m_deadlineNs(0)
+    , m_elapsedNs(0)
+    , m_vmOp(SoakOp::VmRefresh)
+    , m_vmStartNs(0)
+    , m_vmFailed(false)
+    , m_draining(false)
+    , m_finished(false)
+{
+    m_pool.setMaxThreadCount(qMax(1, m_options.threads));
+    connect(m_viewModel, &MtpViewModel::busyChanged, this, &SoakRunner::onBusyChanged);
+    connect(m_viewModel, &MtpViewModel::operationFailed, this, &SoakRunner::onOperationFailed);
+}
+
+QString SoakRunner::opName(SoakOp op) {
+    return QString::fromLatin1(opNames[int(op)]);
+}
+
+SoakOp SoakRunner::opFromName(const QString &name) {
+    for (int i = 0; i < int(SoakOp::Count); ++i) {
+        if (name == QLatin1String(opNames[i]))
+            return SoakOp(i);
+    }
+    return SoakOp::Count;
+}
+
+void SoakRunner::start() {
+    const int threads = qMax(1, m_options.threads);
+    m_runningWorkers.storeRelaxed(threads);
+    m_clock.start();
+    m_deadlineNs = qint64(m_options.durationSec) * 1000000000;
+
+    for (int i = 0; i < threads; ++i) {
+        QtConcurrent::run(&m_pool, [this, i]() {
+            worker(i);
+            if (m_runningWorkers.fetchAndSubAcquire(1) == 1)
+                QMetaObject::invokeMethod(this, &SoakRunner::onWorkersDone, Qt::QueuedConnection);
+        });
+    }
+}
+
+void SoakRunner::worker(int index) {
+    std::mt19937 rng(m_options.seed * 7919u + quint32(index));
+    const QString ownDir = QString("/soak/w%1/").arg(index);
+    m_device->createDirectory(ownDir);
+
+    std::vector<int> weights(m_options.mix, m_options.mix + int(SoakOp::Count));
+    std::discrete_distribution<int> pickOp(weights.begin(), weights.end());
+    std::uniform_int_distribution<int> pickFile(0, qMax(1, m_options.filesPerThread) - 1);
+
+    // What this thread last wrote to each of its own files; a read that
+    // doesn't match is a mismatch. Shared files are never checked.
+    QHash<QString, QByteArray> expected;
+    SoakSamples local;
+
+    while (m_clock.nsecsElapsed() < m_deadlineNs) {
+        const SoakOp op = SoakOp(pickOp(rng));
+        const bool shared = rng() % 4 == 0;
+        const QString path = (shared ? QString("/soak/shared/") : ownDir) + QString("f%1").arg(pickFile(rng));
+        const bool checked = !shared && expected.contains(path);
+
+        if (op == SoakOp::ViewModel) {
+            static const SoakOp vmOps[] = {SoakOp::VmRefresh, SoakOp::VmRead, SoakOp::VmWrite, SoakOp::VmDelete};
+            const SoakOp vmOp = vmOps[rng() % 4];
+            const QString vmPath = QString("/soak/vm/f%1").arg(pickFile(rng));
+            postViewModelOp(vmOp, vmPath, vmOp == SoakOp::VmWrite ? randomContent(rng, m_options.maxFileBytes) : QByteArray());
+            continue;
+        }
+
+        QByteArray content;
+        if (op == SoakOp::Write)
+            content = randomContent(rng, m_options.maxFileBytes);
+
+        const qint64 start = m_clock.nsecsElapsed();
+        bool ok = false;
+        bool mismatch = false;
+        switch (op) {
+        case SoakOp::Read: {
+            QByteArray data;
+            ok = m_device->readFile(path, data);
+            mismatch = checked && (!ok || data != expected.value(path));
+            break;
+        }
+        case SoakOp::ReadRange: {
+            QByteArray data;
+            const quint64 offset = rng() % quint64(m_options.maxFileBytes + 1);
+            ok = m_device->readRange(path, offset, RangeLength, data);
+            mismatch = checked && (!ok || data != expected.value(path).mid(qsizetype(offset), qsizetype(RangeLength)));
+            break;
+        }
+        case SoakOp::Write:
+            ok = m_device->writeFile(path, content);
+            break;
+        case SoakOp::Delete:
+            ok = m_device->deleteFile(path);
+            break;
+        case SoakOp::List:
+            ok = !m_device->getFileInfoList(shared ? QString("/soak/shared/") : ownDir).isEmpty();
+            break;
+        case SoakOp::Stat: {
+            MtpFileInfo info;
+            ok = m_device->statFile(path, info);
+            mismatch = checked && (!ok || info.size != quint64(expected.value(path).size()));
+            break;
+        }
+        case SoakOp::Mkdir:
+            ok = m_device->createDirectory(QString("/soak/shared/d%1/").arg(pickFile(rng)));
+            break;
+        case SoakOp::Rmdir:
+            ok = m_device->deleteDirectory(QString("/soak/shared/d%1/").arg(pickFile(rng)));
+            break;
+        default:
+            break;
+        }
+        local.latencyNs[int(op)].append(m_clock.nsecsElapsed() - start);
+
+        if (!ok)
+            ++local.failures[int(op)];
+        if (mismatch) {
+            m_mismatches.fetchAndAddRelaxed(1);
+            qCWarning(lcSoak).noquote() << "mismatch on" << opName(op) << path;
+        }
+
+        if (!shared && op == SoakOp::Write) {
+            // A failed write leaves the file in an unknown state.
+            if (ok)
+                expected.insert(path, content);
+            else
+                expected.remove(path);
+        } else if (!shared && op == SoakOp::Delete) {
+            expected.remove(path);
+        }
+    }
+
+    QMutexLocker locker(&m_samplesMutex);
+    m_samples.merge(local);
+}
+
+// Called from worker threads. The view model belongs to the main thread,
+// so the call is queued there, as a UI would do it.
+void SoakRunner::postViewModelOp(SoakOp op, const QString &path, const QByteArray &data) {
+    QMetaObject::invokeMethod(this, [this, op, path, data]() {
+        if (m_draining)
+            return;
+        if (m_viewModel->isBusy()) {
+            m_vmSkipped.fetchAndAddRelaxed(1);
+            return;
+        }
+
+        m_vmOp = op;
+        m_vmFailed = false;
+        m_vmStartNs = m_clock.nsecsElapsed();
+        switch (op) {
+        case SoakOp::VmRefresh:
+            m_viewModel->refreshDevice();
+            break;
+        case SoakOp::VmRead:
+            m_viewModel->readFile(path);
+            break;
+        case SoakOp::VmWrite:
+            m_viewModel->writeFile(path, data);
+            break;
+        case SoakOp::VmDelete:
+            m_viewModel->deleteFile(path);
+            break;
+        default:
+            m_vmStartNs = 0;
+            break;
+        }
+    }, Qt::QueuedConnection);
+}
+
+void SoakRunner::onOperationFailed() {
+    if (m_vmStartNs > 0)
+        m_vmFailed = true;
+}
+
+void SoakRunner::onBusyChanged(bool busy) {
+    if (busy || m_vmStartNs == 0)
+        return;
+
+    m_vmSamples.latencyNs[int(m_vmOp)].append(m_clock.nsecsElapsed() - m_vmStartNs);
+    if (m_vmFailed)
+        ++m_vmSamples.failures[int(m_vmOp)];
+    m_vmStartNs = 0;
+
+    if (m_draining)
+        finish();
+}
+
+void SoakRunner::onWorkersDone() {
+    m_elapsedNs = m_clock.nsecsElapsed();
+    m_draining = true;
+
+    // Let the last view model operation land so it is timed, but don't wait
+    // forever on a stuck one.
+    if (!m_viewModel->isBusy())
+        finish();
+    else
+        QTimer::singleShot(30000, this, &SoakRunner::finish);
+}
+
+void SoakRunner::finish() {
+    if (m_finished)
+        return;
+    m_finished = true;
+    if (m_viewModel->isBusy())
+        qCWarning(lcSoak) << "view model still busy after the run; its operation is left out of the report";
+
+    QMutexLocker locker(&m_samplesMutex);
+    m_samples.merge(m_vmSamples);
+    for (QVector<qint64> &latencies : m_samples.latencyNs)
+        std::sort(latencies.begin(), latencies.end());
+    locker.unlock();
+
+    emit finished();
+}
+
+QJsonObject SoakRunner::report() const {
+    const double seconds = qMax<qint64>(1, m_elapsedNs) / 1e9;
+    QJsonObject ops;
+    quint64 total = 0;
+    for (int i = 0; i < int(SoakOp::Count); ++i) {
+        const QVector<qint64> &latencies = m_samples.latencyNs[i];
+        if (latencies.isEmpty())
+            continue;
+        total += quint64(latencies.size());
+        QJsonObject op;
+        op["count"] = double(latencies.size());
+        op["failures"] = double(m_samples.failures[i]);
+        op["opsPerSec"] = latencies.size() / seconds;
+        op["p50Us"] = percentileUs(latencies, 0.50);
+        op["p99Us"] = percentileUs(latencies, 0.99);
+        op["p999Us"] = percentileUs(latencies, 0.999);
+        op["maxUs"] = latencies.last() / 1000.0;
+        ops[opName(SoakOp(i))] = op;
+    }
+
+    QJsonObject result;
+    result["seconds"] = seconds;
+    result["threads"] = m_options.threads;
+    result["seed"] = double(m_options.seed);
+    result["totalOps"] = double(total);
+    result["opsPerSec"] = total / seconds;
+    result["mismatches"] = double(m_mismatches.loadRelaxed());
+    result["vmSkipped"] = double(m_vmSkipped.loadRelaxed());
+    result["ops"] = ops;
+    return result;
+}
+
+QString SoakRunner::textReport() const {
+    const QJsonObject result = report();
+    QString text;
+    QTextStream out(&text);
+    out << QString("%1 ops in %2 s on %3 threads: %4 ops/s, %5 mismatches, %6 view model ops skipped while busy\n")
+               .arg(result["totalOps"].toDouble(), 0, 'f', 0)
+               .arg(result["seconds"].toDouble(), 0, 'f', 1)
+               .arg(result["threads"].toInt())
+               .arg(result["opsPerSec"].toDouble(), 0, 'f', 0)
+               .arg(result["mismatches"].toDouble(), 0, 'f', 0)
+               .arg(result["vmSkipped"].toDouble(), 0, 'f', 0);
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+               .arg(QString("op"), -12).arg(QString("count"), 10).arg(QString("failed"), 8).arg(QString("ops/s"), 10)
+               .arg(QString("p50 us"), 10).arg(QString("p99 us"), 10).arg(QString("p999 us"), 10).arg(QString("max us"), 10);
+
+    const QJsonObject ops = result["ops"].toObject();
+    for (int i = 0; i < int(SoakOp::Count); ++i) {
+        const QJsonObject op = ops[opName(SoakOp(i))].toObject();
+        if (op.isEmpty())
+            continue;
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+                   .arg(opName(SoakOp(i)), -12)
+                   .arg(op["count"].toDouble(), 10, 'f', 0)
+                   .arg(op["failures"].toDouble(), 8, 'f', 0)
+                   .arg(op["opsPerSec"].toDouble(), 10, 'f', 0)
+                   .arg(op["p50Us"].toDouble(), 10, 'f', 0)
+                   .arg(op["p99Us"].toDouble(), 10, 'f', 0)
+                   .arg(op["p999Us"].toDouble(), 10, 'f', 0)
+                   .arg(op["maxUs"].toDouble(), 10, 'f', 0);
+    }
+    return text;
+}
@@ -0,0 +1,108 @@
+#ifndef SOAKRUNNER_H
+#define SOAKRUNNER_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <QVector>
+#include "imtdevice.h"
+
+class MtpViewModel;
+
+enum class SoakOp {
+    Read,
+    ReadRange,
+    Write,
+    Delete,
+    List,
+    Stat,
+    Mkdir,
+    Rmdir,
+    ViewModel,   // pseudo-op in the mix: post one of the Vm* operations below
+    VmRefresh,
+    VmRead,
+    VmWrite,
+    VmDelete,
+    Count
+};
+
+struct SoakOptions {
+    int durationSec = 30;
+    int threads = 4;
+    quint32 seed = 1;
+    int filesPerThread = 32;
+    int maxFileBytes = 256 * 1024;
+    int mix[int(SoakOp::Count)] = {}; // relative weights; the Vm* entries are unused
+};
+
+// Latencies of one thread, merged into the report at the end so the hot
+// path never takes a lock.
+struct SoakSamples {
+    QVector<qint64> latencyNs[int(SoakOp::Count)];
+    quint64 failures[int(SoakOp::Count)] = {};
+
+    void merge(const SoakSamples &other);
+};
+
+// Runs random mixes of operations against one IMtpDevice from several
+// threads for a fixed time. Each thread owns /soak/w<n>/ and checks every
+// read there against what it last wrote; /soak/shared/ is contended by all
+// of them and only counted. A share of the mix is posted to the view model
+// (which lives on the main thread) from the worker threads, the way a UI
+// would, and timed from acceptance to the busy flag dropping.
+class SoakRunner : public QObject {
+    Q_OBJECT
+
+public:
+    SoakRunner(IMtpDevice *device, MtpViewModel *viewModel, const SoakOptions &options, QObject *parent = nullptr);
+
+    static QString opName(SoakOp op);
+    static SoakOp opFromName(const QString &name);
+
+    void start();
+
+    // Valid after finished().
+    QJsonObject report() const;
+    QString textReport() const;
+    quint64 mismatches() const { return m_mismatches.loadRelaxed(); }
+
+signals:
+    void finished();
+
+private:
+    void worker(int index);
+    void postViewModelOp(SoakOp op, const QString &path, const QByteArray &data);
+    void onBusyChanged(bool busy);
+    void onOperationFailed();
+    void onWorkersDone();
+    void finish();
+
+    IMtpDevice *m_device;
+    MtpViewModel *m_viewModel;
+    SoakOptions m_options;
+
+    QElapsedTimer m_clock;
+    qint64 m_deadlineNs;
+    qint64 m_elapsedNs;
+    QThreadPool m_pool;
+    QAtomicInt m_runningWorkers;
+
+    QMutex m_samplesMutex;
+    SoakSamples m_samples;
+
+    // Main thread only.
+    SoakSamples m_vmSamples;
+    SoakOp m_vmOp;
+    qint64 m_vmStartNs;
+    bool m_vmFailed;
+    bool m_draining;
+    bool m_finished;
+
+    QAtomicInteger<quint64> m_mismatches;
+    QAtomicInteger<quint64> m_vmSkipped;
+};
+
+#endif // SOAKRUNNER_H